@@ -2,15 +2,53 @@
 #include "llvm/IR/Function.h"
 #include "llvm/Pass.h"
 #include "llvm/Support/raw_ostream.h"
+#include "llvm/Support/raw_os_ostream.h"
 #include "llvm/IR/Dominators.h"
 #include "llvm/IR/InstrTypes.h"
+#include "llvm/IR/Instructions.h"
+#include "llvm/IR/IRBuilder.h"
+#include "llvm/IR/Module.h"
+#include "llvm/IR/CFG.h"
 #include "llvm/Analysis/LoopInfo.h"
 #include "llvm/Analysis/PostDominators.h"
+#include "llvm/Analysis/BlockFrequencyInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
 #include "llvm/ADT/DepthFirstIterator.h"
+#include "llvm/ADT/SCCIterator.h"
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/BitVector.h"
+#include "llvm/ADT/Hashing.h"
+#include "llvm/IRReader/IRReader.h"
+#include "llvm/Support/SourceMgr.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/CommandLine.h"
+#include "llvm/Support/Format.h"
 #include <vector>
 #include <iostream>
 #include <queue>
 #include <limits>
+#include <map>
+#include <set>
+#include <string>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <list>
+#include <cstring>
+#include <cerrno>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <poll.h>
+#include <sys/un.h>
+#include <unistd.h>
 
 using namespace llvm;
 
@@ -18,6 +56,310 @@ using namespace llvm;
 
 //STATISTIC(HelloCounter, "Counts number of functions greeted");
 
+/* Per-function cost budget for the expensive passes (warshall, reach, dc, cdep).
+ * Before running, each of these passes estimates the cost of every variant it
+ * has from the block/edge counts, runs the fastest one that fits, and skips
+ * the function (saying why) when none does. An "op" is whatever the variant's
+ * inner loop does, so op counts only compare within one variant; the time
+ * estimates use per-variant ns/op measured on a ~3 GHz x86-64 box, -O2, and
+ * are the ones to budget on across passes. */
+static cl::opt<double> BudgetOps("budget-ops", cl::init(0),
+	cl::desc("Max estimated operations per function for warshall/reach/dc/cdep (0 = unlimited)"));
+static cl::opt<double> BudgetMB("budget-mb", cl::init(0),
+	cl::desc("Max estimated memory in MB per function for warshall/reach/dc/cdep (0 = unlimited)"));
+static cl::opt<double> BudgetSeconds("budget-seconds", cl::init(0),
+	cl::desc("Max estimated seconds per function for warshall/reach/dc/cdep (0 = unlimited)"));
+
+namespace {
+	/* one way of computing a pass's result, with its estimated cost on a function */
+	struct Variant {
+		const char *name;
+		double ops;
+		double bytes;
+		double ns;	/* calibrated time estimate */
+	};
+}
+
+static bool budget_set() {
+	return BudgetOps != 0 || BudgetMB != 0 || BudgetSeconds != 0;
+}
+
+static unsigned count_edges(Function &F) {
+	unsigned edges = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+		edges += bb->getTerminator()->getNumSuccessors();
+	return edges;
+}
+
+/* gives every block of F a dense id in layout order */
+static void number_blocks(Function &F, DenseMap<const BasicBlock *, unsigned> &ids) {
+	ids.clear();
+	unsigned id = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+		ids[&*bb] = id++;
+}
+
+/* Intra-function parallelism for the closure computations in warshall and
+ * reach. Functions smaller than this stay on one thread. */
+static cl::opt<unsigned> ClosureThreads("closure-threads", cl::init(1),
+	cl::desc("Threads for warshall/reach closure computations inside one function"));
+static cl::opt<bool> ClosureBench("closure-bench", cl::init(false),
+	cl::desc("warshall/reach: time the parallel closure engines on 1 to 64 threads"));
+static const unsigned MIN_PARALLEL_BLOCKS = 256;
+
+static unsigned closure_threads(Function &F) {
+	return F.size() < MIN_PARALLEL_BLOCKS ? 1 : std::max(1u, (unsigned)ClosureThreads);
+}
+
+/* Worker threads kept for the whole of one closure computation. run() hands
+ * out one step's tasks and returns once all of them are done, so steps that
+ * depend on each other (Floyd-Warshall's k, DAG levels) only pay for a
+ * barrier, not for starting threads. Each worker starts on an even share of
+ * the step's tasks and, once its share is done, steals single tasks from the
+ * other workers' shares. The calling thread is worker 0. */
+namespace {
+	struct ParallelPool {
+		struct Share {
+			std::atomic<unsigned> next;
+			unsigned end;
+		};
+		unsigned threads;
+		std::unique_ptr<Share[]> shares;
+		std::vector<std::thread> workers;
+		std::function<void(unsigned, unsigned)> task;
+		std::mutex lock;
+		std::condition_variable start_cv, done_cv;
+		unsigned step;		/* bumped to start a step */
+		unsigned running;	/* helper threads still in the current step */
+		bool stopping;
+
+		ParallelPool(unsigned threads)
+			: threads(std::max(1u, threads)), shares(new Share[this->threads]),
+			  step(0), running(0), stopping(false) {
+			for (unsigned w = 1; w < this->threads; w++)
+				workers.push_back(std::thread(&ParallelPool::helper, this, w));
+		}
+
+		~ParallelPool() {
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				stopping = true;
+			}
+			start_cv.notify_all();
+			for (unsigned w = 0; w < workers.size(); w++)
+				workers[w].join();
+		}
+
+		/* runs fn(task, worker) for every task in [0, n) */
+		template <typename Fn>
+		void run(unsigned n, Fn fn) {
+			if (threads == 1 || n <= 1) {
+				for (unsigned t = 0; t < n; t++)
+					fn(t, 0);
+				return;
+			}
+			for (unsigned w = 0; w < threads; w++) {
+				shares[w].next = (uint64_t)n * w / threads;
+				shares[w].end = (uint64_t)n * (w + 1) / threads;
+			}
+			task = fn;
+			{
+				std::lock_guard<std::mutex> guard(lock);
+				step++;
+				running = threads - 1;
+			}
+			start_cv.notify_all();
+			work(0);
+			std::unique_lock<std::mutex> guard(lock);
+			done_cv.wait(guard, [&] { return running == 0; });
+		}
+
+		void work(unsigned w) {
+			for (unsigned v = 0; v < threads; v++) {
+				Share &share = shares[(w + v) % threads];
+				for (;;) {
+					unsigned t = share.next.fetch_add(1);
+					if (t >= share.end)
+						break;
+					task(t, w);
+				}
+			}
+		}
+
+		void helper(unsigned w) {
+			unsigned seen = 0;
+			for (;;) {
+				{
+					std::unique_lock<std::mutex> guard(lock);
+					start_cv.wait(guard, [&] { return stopping || step != seen; });
+					if (stopping)
+						return;
+					seen = step;
+				}
+				work(w);
+				std::lock_guard<std::mutex> guard(lock);
+				if (--running == 0)
+					done_cv.notify_one();
+			}
+		}
+	};
+}
+
+/* one-step convenience: a pool just for these n tasks */
+template <typename Fn>
+static void parallel_for(unsigned n, unsigned threads, Fn fn) {
+	ParallelPool pool(std::min(threads, std::max(1u, n)));
+	pool.run(n, fn);
+}
+
+template <typename Fn>
+static double time_ns(Fn fn) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	fn();
+	return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool fits_budget(double ops, double bytes, double ns) {
+	return (BudgetOps == 0 || ops <= BudgetOps) &&
+	       (BudgetMB == 0 || bytes <= BudgetMB * 1024.0 * 1024.0) &&
+	       (BudgetSeconds == 0 || ns <= BudgetSeconds * 1e9);
+}
+
+/* Returns the index of the fastest variant that fits the budget. If none
+ * fits, prints why F is skipped and returns -1. */
+static int pick_variant(const char *pass, Function &F, const std::vector<Variant> &variants) {
+	int best = -1;
+	int cheapest = -1;
+	for (unsigned i = 0; i < variants.size(); i++) {
+		const Variant &v = variants[i];
+		if (cheapest == -1 || v.ns < variants[cheapest].ns)
+			cheapest = i;
+		if (!fits_budget(v.ops, v.bytes, v.ns))
+			continue;
+		if (best == -1 || v.ns < variants[best].ns)
+			best = i;
+	}
+	if (best == -1) {
+		const Variant &v = variants[cheapest];
+		errs() << "[budget] " << pass << ": skipped " << F.getName()
+		       << " (" << F.size() << " blocks): cheapest variant '" << v.name
+		       << "' needs ~" << format("%.3g", v.ops) << " ops / "
+		       << format("%.3g", v.bytes / (1024.0 * 1024.0)) << " MB / "
+		       << format("%.3g", v.ns / 1e9) << " s, budget is "
+		       << format("%.3g", (double)BudgetOps) << " ops / "
+		       << format("%.3g", (double)BudgetMB) << " MB / "
+		       << format("%.3g", (double)BudgetSeconds) << " s\n";
+		return -1;
+	}
+	if (budget_set())
+		errs() << "[budget] " << pass << ": " << F.getName() << " using '"
+		       << variants[best].name << "' (~" << format("%.3g", variants[best].ops) << " ops, ~"
+		       << format("%.3g", variants[best].ns / 1e9) << " s)\n";
+	return best;
+}
+
+/* Keeps the N highest-scoring items seen so far in a min-heap, so a
+ * module-wide ranking never stores more than N entries. T needs a score. */
+template <typename T>
+struct TopN {
+	unsigned limit;
+	std::vector<T> heap;
+
+	TopN() : limit(0) {}
+
+	static bool greater(const T &a, const T &b) {
+		return a.score > b.score;
+	}
+
+	void insert(const T &item) {
+		if (limit == 0)
+			return;
+		if (heap.size() < limit) {
+			heap.push_back(item);
+			std::push_heap(heap.begin(), heap.end(), greater);
+		} else if (heap.front().score < item.score) {
+			std::pop_heap(heap.begin(), heap.end(), greater);
+			heap.back() = item;
+			std::push_heap(heap.begin(), heap.end(), greater);
+		}
+	}
+
+	/* highest score first */
+	std::vector<T> sorted() const {
+		std::vector<T> items = heap;
+		std::sort(items.begin(), items.end(), greater);
+		return items;
+	}
+};
+
+/* Instruction census for bbcount: per-opcode counters filled in the same
+ * walk that counts blocks, plus a few opcode classes used for triage */
+static cl::opt<bool> InstCensus("inst-census", cl::init(false),
+	cl::desc("bbcount: count instructions by opcode per function and per loop"));
+static cl::opt<unsigned> CensusTop("census-top", cl::init(10),
+	cl::desc("bbcount: number of functions to list by memory-op and call density"));
+
+namespace {
+	enum InstClass { CLS_LOAD, CLS_STORE, CLS_CALL, CLS_BRANCH, CLS_FP, CLS_VECTOR, CLS_COUNT };
+	const char *const inst_class_names[CLS_COUNT] = {
+		"loads", "stores", "calls", "branches", "fp", "vector"
+	};
+
+	struct InstMix {
+		unsigned opcodes[Instruction::OtherOpsEnd];
+		unsigned classes[CLS_COUNT];
+		unsigned total;
+
+		InstMix() : total(0) {
+			std::fill(opcodes, opcodes + Instruction::OtherOpsEnd, 0);
+			std::fill(classes, classes + CLS_COUNT, 0);
+		}
+
+		void add(const Instruction &I) {
+			unsigned op = I.getOpcode();
+			opcodes[op]++;
+			total++;
+			switch (op) {
+			case Instruction::Load: classes[CLS_LOAD]++; break;
+			case Instruction::Store: classes[CLS_STORE]++; break;
+			case Instruction::Call:
+			case Instruction::Invoke: classes[CLS_CALL]++; break;
+			case Instruction::Br:
+			case Instruction::Switch:
+			case Instruction::IndirectBr: classes[CLS_BRANCH]++; break;
+			}
+			/* by value type, plus compares and stores whose operands carry the type */
+			Type *Ty = I.getType();
+			if (isa<CmpInst>(I) || isa<StoreInst>(I))
+				Ty = I.getOperand(0)->getType();
+			if (Ty->isFPOrFPVectorTy())
+				classes[CLS_FP]++;
+			if (Ty->isVectorTy())
+				classes[CLS_VECTOR]++;
+		}
+
+		void merge(const InstMix &other) {
+			for (unsigned i = 0; i < Instruction::OtherOpsEnd; i++)
+				opcodes[i] += other.opcodes[i];
+			for (unsigned i = 0; i < CLS_COUNT; i++)
+				classes[i] += other.classes[i];
+			total += other.total;
+		}
+
+		void print(raw_ostream &os) const {
+			os << total << " insts";
+			for (unsigned i = 0; i < CLS_COUNT; i++)
+				os << ", " << inst_class_names[i] << " " << classes[i];
+		}
+	};
+
+	struct DenseFunc {
+		double score;	/* fraction of the function's instructions */
+		unsigned total;
+		std::string name;
+	};
+}
+
 /* Question 1 */
 namespace {
 	struct BasicBlockCount : public FunctionPass {
@@ -25,21 +367,91 @@ namespace {
 		static int func_count;
 		static std::vector<int> func_bbcounts;
 		//static std::map<std::string, int> func_bbcount; // each function's basic block count
+		static InstMix module_mix;
+		static TopN<DenseFunc> mem_dense;
+		static TopN<DenseFunc> call_dense;
 		BasicBlockCount() : FunctionPass(ID) {}
 
+		void getAnalysisUsage(AnalysisUsage &AU) const {
+			if (InstCensus)
+				AU.addRequired<LoopInfoWrapperPass>();
+			AU.setPreservesAll();
+		}
+
+		bool doInitialization(Module &M) override {
+			mem_dense.limit = CensusTop;
+			call_dense.limit = CensusTop;
+			return false;
+		}
+
 		bool runOnFunction(Function &F) override {
 			func_count++;
 			//++HelloCounter;
 			int bb_count = 0;
+			InstMix mix;
+			/* per-loop mixes include their sub-loops' instructions; loops are
+			 * kept in the order their first block is seen */
+			std::vector<std::pair<Loop *, InstMix> > loop_mix;
+			DenseMap<Loop *, unsigned> loop_index;
+			LoopInfo *LI = NULL;
+			if (InstCensus)
+				LI = &getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
 			/* iterates over basic blocks in a function */
-			for (Function::iterator bb = F.begin(), e = F.end(); bb != e; bb++)
+			for (Function::iterator bb = F.begin(), e = F.end(); bb != e; bb++) {
 				bb_count++;
+				if (!InstCensus)
+					continue;
+				InstMix block_mix;
+				for (BasicBlock::iterator inst = bb->begin(); inst != bb->end(); inst++)
+					block_mix.add(*inst);
+				mix.merge(block_mix);
+				for (Loop *L = LI->getLoopFor(&*bb); L; L = L->getParentLoop()) {
+					if (!loop_index.count(L)) {
+						loop_index[L] = loop_mix.size();
+						loop_mix.push_back(std::make_pair(L, InstMix()));
+					}
+					loop_mix[loop_index[L]].second.merge(block_mix);
+				}
+			}
 			func_bbcounts.push_back(bb_count);
 			std::cout << "basic block count in function: "
 				  << bb_count << "\n";
+			if (InstCensus)
+				report(F, mix, loop_mix);
 			return false;
 		}
 
+		void report(Function &F, const InstMix &mix, const std::vector<std::pair<Loop *, InstMix> > &loop_mix) {
+			raw_os_ostream out(std::cout);
+			out << F.getName() << ": ";
+			mix.print(out);
+			out << "\n";
+			for (std::vector<std::pair<Loop *, InstMix> >::const_iterator it = loop_mix.begin(); it != loop_mix.end(); it++) {
+				out << "  loop " << it->first->getHeader()->getName()
+				    << " (depth " << it->first->getLoopDepth() << "): ";
+				it->second.print(out);
+				out << "\n";
+			}
+			module_mix.merge(mix);
+			if (mix.total == 0)
+				return;
+			DenseFunc df;
+			df.total = mix.total;
+			df.name = F.getName().str();
+			df.score = double(mix.classes[CLS_LOAD] + mix.classes[CLS_STORE]) / mix.total;
+			mem_dense.insert(df);
+			df.score = double(mix.classes[CLS_CALL]) / mix.total;
+			call_dense.insert(df);
+		}
+
+		void print_dense(const char *what, const TopN<DenseFunc> &top) {
+			std::vector<DenseFunc> funcs = top.sorted();
+			std::cout << "top functions by " << what << " density:\n";
+			for (unsigned i = 0; i < funcs.size(); i++)
+				std::cout << i + 1 << ". " << funcs[i].name << ": " << funcs[i].score * 100
+					  << "% of " << funcs[i].total << " insts\n";
+		}
+
 		/* Apparently this gets called once runOnfunction() is done with all the functions */
 		bool doFinalization(Module &M) override {
 			std::cout << "Summary: " << "\n";
@@ -51,6 +463,18 @@ namespace {
 			// find avg from vector
 			std::cout << "avg: " << getavg() << "\n";
 			// print all three
+			if (InstCensus) {
+				raw_os_ostream out(std::cout);
+				out << "instructions: ";
+				module_mix.print(out);
+				out << "\n";
+				for (unsigned op = 0; op < Instruction::OtherOpsEnd; op++)
+					if (module_mix.opcodes[op])
+						out << "  " << Instruction::getOpcodeName(op) << ": " << module_mix.opcodes[op] << "\n";
+				out.flush();
+				print_dense("memory-op", mem_dense);
+				print_dense("call", call_dense);
+			}
 			return false;
 		}
 
@@ -95,27 +519,136 @@ namespace {
 char BasicBlockCount::ID = 0;
 int BasicBlockCount::func_count;
 std::vector<int> BasicBlockCount::func_bbcounts;
+InstMix BasicBlockCount::module_mix;
+TopN<DenseFunc> BasicBlockCount::mem_dense;
+TopN<DenseFunc> BasicBlockCount::call_dense;
 static RegisterPass<BasicBlockCount> X("bbcount", "Basic Block count for every function");
 
 /* Question 2: number of CFG edges */
+
+/* Branch structure, gathered in the same walk: terminator kinds, critical
+ * edges (from a block with several successors to one with several
+ * predecessors) and a histogram of successor counts. Functions with a very
+ * wide switch or many critical edges get flagged in the summary. */
+static cl::opt<unsigned> SwitchFanoutThreshold("switch-fanout-threshold", cl::init(64),
+	cl::desc("cfg: flag functions with a switch of at least this many successors"));
+static cl::opt<double> CriticalRatioThreshold("critical-ratio-threshold", cl::init(0.25),
+	cl::desc("cfg: flag functions where at least this fraction of edges is critical"));
+
 namespace {
+	enum TermKind { TERM_UNCOND, TERM_COND, TERM_SWITCH, TERM_INDIRECT, TERM_OTHER, TERM_COUNT };
+	const char *const term_kind_names[TERM_COUNT] = {
+		"uncond br", "cond br", "switch", "indirectbr", "other"
+	};
+
+	/* successor count buckets: 0, 1, 2, 3-4, 5-8, 9-16, 17+ */
+	enum { FANOUT_BUCKETS = 7 };
+	const char *const fanout_names[FANOUT_BUCKETS] = { "0", "1", "2", "3-4", "5-8", "9-16", "17+" };
+
+	unsigned fanout_bucket(unsigned succs) {
+		if (succs <= 2)
+			return succs;
+		unsigned bucket = 3;
+		for (unsigned limit = 4; bucket < FANOUT_BUCKETS - 1 && succs > limit; limit *= 2)
+			bucket++;
+		return bucket;
+	}
+
+	struct BranchStats {
+		unsigned kinds[TERM_COUNT];
+		unsigned fanout[FANOUT_BUCKETS];
+		unsigned critical;
+		unsigned max_switch;
+
+		BranchStats() : critical(0), max_switch(0) {
+			std::fill(kinds, kinds + TERM_COUNT, 0);
+			std::fill(fanout, fanout + FANOUT_BUCKETS, 0);
+		}
+
+		void print(raw_ostream &os, unsigned edges) const {
+			os << "critical " << critical << "/" << edges;
+			for (unsigned i = 0; i < TERM_COUNT; i++)
+				os << ", " << term_kind_names[i] << " " << kinds[i];
+			os << ", fan-out [";
+			for (unsigned i = 0; i < FANOUT_BUCKETS; i++)
+				os << (i ? " " : "") << fanout_names[i] << ":" << fanout[i];
+			os << "]";
+		}
+	};
+
 	struct CFGEdges : public FunctionPass {
 		static char ID;
 		static int func_count;
 		static std::vector<unsigned> edges;
+		static BranchStats module_stats;
+		static std::vector<std::string> flagged;
 		CFGEdges() : FunctionPass(ID) {}
 
 		bool runOnFunction(Function &F) override {
 			func_count++;
 			unsigned edge_count = 0;
+			BranchStats stats;
+			DenseMap<const BasicBlock *, unsigned> ids;
+			number_blocks(F, ids);
+			std::vector<unsigned> preds(F.size(), 0);
+			/* destinations of edges leaving multi-successor blocks; critical
+			 * once all predecessors are counted */
+			std::vector<unsigned> multi_dests;
 
 			//BasicBlock &entry_block = F.getEntryBlock();
 			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
 				BasicBlock &blk = *bb;
 				const TerminatorInst *TInst = blk.getTerminator();
-				edge_count += TInst->getNumSuccessors();
+				unsigned nSucc = TInst->getNumSuccessors();
+				edge_count += nSucc;
+
+				if (const BranchInst *BI = dyn_cast<BranchInst>(TInst))
+					stats.kinds[BI->isConditional() ? TERM_COND : TERM_UNCOND]++;
+				else if (isa<SwitchInst>(TInst)) {
+					stats.kinds[TERM_SWITCH]++;
+					stats.max_switch = std::max(stats.max_switch, nSucc);
+				} else if (isa<IndirectBrInst>(TInst))
+					stats.kinds[TERM_INDIRECT]++;
+				else
+					stats.kinds[TERM_OTHER]++;
+				stats.fanout[fanout_bucket(nSucc)]++;
+
+				for (unsigned i = 0; i < nSucc; i++) {
+					unsigned id = ids[TInst->getSuccessor(i)];
+					preds[id]++;
+					if (nSucc > 1)
+						multi_dests.push_back(id);
+				}
 			}
+			for (unsigned i = 0; i < multi_dests.size(); i++)
+				if (preds[multi_dests[i]] > 1)
+					stats.critical++;
 			edges.push_back(edge_count);
+
+			errs() << F.getName() << ": ";
+			stats.print(errs(), edge_count);
+			errs() << "\n";
+
+			/* no edges means nothing to flag, even with a zero threshold */
+			double ratio = edge_count ? double(stats.critical) / edge_count : -1;
+			if (stats.max_switch >= SwitchFanoutThreshold || ratio >= CriticalRatioThreshold) {
+				std::ostringstream why;
+				why << F.getName().str() << ": ";
+				if (stats.max_switch >= SwitchFanoutThreshold)
+					why << "switch fan-out " << stats.max_switch;
+				if (stats.max_switch >= SwitchFanoutThreshold && ratio >= CriticalRatioThreshold)
+					why << ", ";
+				if (ratio >= CriticalRatioThreshold)
+					why << "critical edges " << stats.critical << "/" << edge_count;
+				flagged.push_back(why.str());
+			}
+
+			for (unsigned i = 0; i < TERM_COUNT; i++)
+				module_stats.kinds[i] += stats.kinds[i];
+			for (unsigned i = 0; i < FANOUT_BUCKETS; i++)
+				module_stats.fanout[i] += stats.fanout[i];
+			module_stats.critical += stats.critical;
+			module_stats.max_switch = std::max(module_stats.max_switch, stats.max_switch);
 			return false;
 		}
 
@@ -130,6 +663,19 @@ namespace {
 			std::cout << "Min: " << findmin() << "\n";
 			std::cout << "Average: " << getavg() << "\n";
 			std::cout << "vector size: " << edges.size() << "\n";
+			unsigned total = 0;
+			for (std::vector<unsigned>::iterator it = edges.begin(); it != edges.end(); it++)
+				total += *it;
+			raw_os_ostream out(std::cout);
+			out << "Branch structure: ";
+			module_stats.print(out, total);
+			out << "\n";
+			out.flush();
+			std::cout << "flagged functions (switch fan-out >= " << SwitchFanoutThreshold
+				  << " or critical edge ratio >= " << CriticalRatioThreshold << "): "
+				  << flagged.size() << "\n";
+			for (unsigned i = 0; i < flagged.size(); i++)
+				std::cout << "  " << flagged[i] << "\n";
 			return false;
 		}
 
@@ -173,11 +719,28 @@ namespace {
 
 char CFGEdges::ID = 0;
 std::vector<unsigned> CFGEdges::edges;
+BranchStats CFGEdges::module_stats;
+std::vector<std::string> CFGEdges::flagged;
 int CFGEdges::func_count;
 static RegisterPass<CFGEdges> Y("cfg", "CFG edge count inside functions");
 
 /* Quesiton 3: counts all back edges */
 /* back edges are defined as edge (b,a) where a dominates b */
+static int count_backedges(Function &F, DominatorTree &DT) {
+	int backedges = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+		BasicBlock &blk = *bb;
+		const TerminatorInst *TInst = blk.getTerminator();
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+			BasicBlock *succ = TInst->getSuccessor(i);
+			if (DT.dominates(succ, &blk)) {
+				backedges++;
+			}
+		}
+	}
+	return backedges;
+}
+
 namespace {
 	struct SingleEntryLoop : public FunctionPass {
 		static char ID;
@@ -192,19 +755,8 @@ namespace {
 
 		bool runOnFunction(Function &F) override {
 			func_count++;
-			int backedges = 0;
 			DominatorTree *DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
-			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
-				BasicBlock &blk = *bb;
-				const TerminatorInst *TInst = blk.getTerminator();
-				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
-					BasicBlock *succ = TInst->getSuccessor(i);
-					if (DT->dominates(succ, &blk)) {
-						backedges++;
-					}
-				}
-			}
-			sel.push_back(backedges);
+			sel.push_back(count_backedges(F, *DT));
 			return false;
 		}
 
@@ -266,22 +818,119 @@ int SingleEntryLoop::func_count;
 std::vector<int> SingleEntryLoop::sel;
 static RegisterPass<SingleEntryLoop> Z("sel", "Single entry loop count inside functions");
 
+/* preorder walk of the loop forest in program order, with an explicit stack;
+ * shared by lbb, allloops, loopnest, cfgdiff and dupcfg */
+template <typename Fn>
+static void for_each_loop(LoopInfo &LI, Fn fn) {
+	std::vector<Loop *> stack(LI.rbegin(), LI.rend());
+	while (!stack.empty()) {
+		Loop *L = stack.back();
+		stack.pop_back();
+		const std::vector<Loop *> &subloops = L->getSubLoops();
+		stack.insert(stack.end(), subloops.rbegin(), subloops.rend());
+		fn(L);
+	}
+}
+
+/* Hotness weighting for lbb and allloops. Block frequencies come from
+ * BlockFrequencyInfo, which uses !prof branch weights when present and
+ * static heuristics otherwise. */
+static cl::opt<bool> Hotness("hotness", cl::init(false),
+	cl::desc("Weight lbb/allloops by block frequency and rank the hottest loops"));
+static cl::opt<unsigned> HotLoopCount("hot-loops", cl::init(10),
+	cl::desc("Number of hottest loops to list module-wide with -hotness"));
+
+namespace {
+	struct HotLoop {
+		double score;	/* estimated block executions, see loop_heat() */
+		double share;	/* fraction of the function's block executions, nested loops included */
+		double self_share;	/* same, for the blocks the score counts */
+		unsigned depth;
+		std::string func;
+		std::string header;
+	};
+}
+
+/* PGO entry count of F, or 1 so that heat stays per-call without a profile */
+static double entry_count(Function &F) {
+	if (Optional<uint64_t> count = F.getEntryCount())
+		return *count;
+	return 1;
+}
+
+static double function_freq(Function &F, BlockFrequencyInfo &BFI) {
+	double freq = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+		freq += BFI.getBlockFreq(&*bb).getFrequency();
+	return freq;
+}
+
+/* Block executions in L's own blocks (not those of its sub-loops),
+ * normalized to one call of F and scaled by the profile entry count when
+ * there is one, so loops compare across functions and an outer loop doesn't
+ * outrank the hot inner loop it encloses. */
+static HotLoop loop_heat(Function &F, Loop *L, LoopInfo &LI, BlockFrequencyInfo &BFI, double func_freq) {
+	double freq = 0, self_freq = 0;
+	for (Loop::block_iterator bb = L->block_begin(); bb != L->block_end(); bb++) {
+		double f = BFI.getBlockFreq(*bb).getFrequency();
+		freq += f;
+		if (LI.getLoopFor(*bb) == L)
+			self_freq += f;
+	}
+	HotLoop hl;
+	hl.score = self_freq / BFI.getEntryFreq() * entry_count(F);
+	hl.share = func_freq > 0 ? freq / func_freq : 0;
+	hl.self_share = func_freq > 0 ? self_freq / func_freq : 0;
+	hl.depth = L->getLoopDepth();
+	hl.func = F.getName().str();
+	hl.header = L->getHeader()->getName().str();
+	return hl;
+}
+
+static void print_hot_loops(const TopN<HotLoop> &hot) {
+	std::vector<HotLoop> loops = hot.sorted();
+	std::cout << "Hottest loops (block executions outside sub-loops"
+		  << " per call, or total with a profile entry count):\n";
+	for (unsigned i = 0; i < loops.size(); i++) {
+		const HotLoop &hl = loops[i];
+		std::cout << i + 1 << ". " << hl.func << ":" << hl.header
+			  << " depth " << hl.depth << ", heat " << hl.score
+			  << ", " << hl.self_share * 100 << "% of function ("
+			  << hl.share * 100 << "% with sub-loops)\n";
+	}
+}
+
 /* Question 4 */
 namespace {
 	struct LoopBasicBlock : public FunctionPass {
 		static char ID;
 		static int func_count;
 		static std::vector<int> lbb;
+		static TopN<HotLoop> hot;
 		LoopBasicBlock() : FunctionPass(ID) {}
 
 		void getAnalysisUsage(AnalysisUsage &AU) const {
 			AU.addRequired<LoopInfoWrapperPass>();
+			if (Hotness)
+				AU.addRequired<BlockFrequencyInfoWrapperPass>();
 			AU.setPreservesAll();
 		}
 
+		/* options are only parsed after static initialization */
+		bool doInitialization(Module &M) override {
+			hot.limit = HotLoopCount;
+			return false;
+		}
+
 		bool runOnFunction(Function &F) override {
 			func_count++;
 			LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+			BlockFrequencyInfo *BFI = NULL;
+			double func_freq = 0;
+			if (Hotness) {
+				BFI = &getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI();
+				func_freq = function_freq(F, *BFI);
+			}
 			int loop_count = 0;
 			int bbcount = 0;
 			errs() << F.getName() + "\n";
@@ -296,8 +945,16 @@ namespace {
 				errs() << "loop ";
 				errs() << loop_count;
 				errs() << ": #BBs = ";
-				errs() << bbcount << "\n";
+				errs() << bbcount;
+				if (BFI) {
+					HotLoop hl = loop_heat(F, L, LI, *BFI, func_freq);
+					errs() << ", share = " << format("%.1f", hl.share * 100) << "%";
+				}
+				errs() << "\n";
 			}
+			/* the ranking covers every loop, not just the top-level ones listed */
+			if (BFI)
+				for_each_loop(LI, [&](Loop *L) { hot.insert(loop_heat(F, L, LI, *BFI, func_freq)); });
 			lbb.push_back(bbcount);
 			return false;
 		}
@@ -314,6 +971,8 @@ namespace {
 			std::cout << "Min: " << findmin() << "\n";
 			std::cout << "Average: " << getavg() << "\n";
 			std::cout << "vector length (# of functions): " << lbb.size() << "\n";
+			if (Hotness)
+				print_hot_loops(hot);
 			return false;
 		}
 
@@ -358,13 +1017,45 @@ namespace {
 char LoopBasicBlock::ID = 0;
 int LoopBasicBlock::func_count;
 std::vector<int> LoopBasicBlock::lbb;
+TopN<HotLoop> LoopBasicBlock::hot;
 static RegisterPass<LoopBasicBlock> A("lbb", "Loop basic block count inside functions");
 
 /* Question 5 */
+
+/* reference: asks the dominator tree about every pair of blocks, O(n^2) */
+static int dom_count_pairwise(Function &F, DominatorTree &DT) {
+	int dom_count = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+		BasicBlock &blk = *bb;
+		for (Function::iterator bb_tail = F.begin(); bb_tail != F.end(); bb_tail++) {
+			BasicBlock &blk_tail = *bb_tail;
+			if (DT.properlyDominates(&blk_tail, &blk))
+				dom_count++;
+		}
+	}
+	return dom_count;
+}
+
+/* same count in O(n): the proper dominators of a reachable block are exactly
+ * its ancestors in the dominator tree, while an unreachable block counts as
+ * dominated by every other block */
+static int dom_count_depth(Function &F, DominatorTree &DT) {
+	int dom_count = 0;
+	int reachable = 0;
+	for (df_iterator<DomTreeNode *> node = df_begin(DT.getRootNode()),
+		     node_end = df_end(DT.getRootNode()); node != node_end; ++node) {
+		dom_count += node.getPathLength() - 1;
+		reachable++;
+	}
+	int n = F.size();
+	return dom_count + (n - reachable) * (n - 1);
+}
+
 namespace {
 	struct DomCount : public FunctionPass {
 		static char ID;
 		static int bb_count;
+		static int skipped;
 		static std::vector<int> dom_counts;
 		DomCount() : FunctionPass(ID) {}
 
@@ -377,31 +1068,21 @@ namespace {
 			int dom_count = 0;
 			DominatorTree *DT = &getAnalysis<DominatorTreeWrapperPass>().getDomTree();
 
-			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
-				bb_count++;
-				BasicBlock &blk = *bb;
-
-				for (Function::iterator bb_tail = F.begin(); bb_tail != F.end(); bb_tail++) {
-					BasicBlock &blk_tail = *bb_tail;
-					if (DT->properlyDominates(&blk_tail, &blk))
-						dom_count++;
-				}
-
-				// for (auto node = GraphTraits<DominatorTree *>::nodes_begin(DT);
-				//      node != GraphTraits<DominatorTree *>::nodes_end(DT); ++node) {
-				// 	dom_count++;
-				// 	if (&blk == node->getBlock())
-				// 		break;
-				// }
+			double n = F.size();
+			std::vector<Variant> variants;
+			variants.push_back({"pairwise", n * n, 0, 9 * n * n});
+			variants.push_back({"tree-depth", n, n * sizeof(void *), 70 * n});
+			int v = pick_variant("dc", F, variants);
+			if (v < 0) {
+				skipped++;
+				return false;
 			}
+			if (v == 0)
+				dom_count = dom_count_pairwise(F, *DT);
+			else
+				dom_count = dom_count_depth(F, *DT);
+			bb_count += F.size();
 
-			// for (auto node = GraphTraits<DominatorTree *>::nodes_begin(DT);
-			//      node != GraphTraits<DominatorTree *>::nodes_end(DT); ++node) {
-			// 	dom_count++;
-
-			// 	//BasicBlock *BB = node->getBlock();
-
-			// }
 			errs() << "Dom count in function ";
 			errs() << F.getName() << ": " << dom_count << "\n";
 			dom_counts.push_back(dom_count);
@@ -417,6 +1098,7 @@ namespace {
 			std::cout << "Summary:\n";
 			std::cout << "Average: " << getavg() << "\n";
 			std::cout << "vector length (# of functions): " << dom_counts.size() << "\n";
+			std::cout << "functions skipped (over budget): " << skipped << "\n";
 			return false;
 		}
 
@@ -435,6 +1117,7 @@ namespace {
 
 char DomCount::ID = 0;
 int DomCount::bb_count;
+int DomCount::skipped;
 std::vector<int> DomCount::dom_counts;
 static RegisterPass<DomCount> B("dc",
 				"average number of dominators for a basic block across all functions");
@@ -442,31 +1125,51 @@ static RegisterPass<DomCount> B("dc",
 /* Part 3 */
 
 /* 3.1.1) Count all loops */
+static int count_all_loops(LoopInfo &LI) {
+	int loops = 0;
+	for_each_loop(LI, [&](Loop *) { loops++; });
+	return loops;
+}
+
 namespace {
 	struct AllLoops : public FunctionPass {
 		static char ID;
 		static int loop_count;
+		static TopN<HotLoop> hot;
 		AllLoops() : FunctionPass(ID) {}
 
 		void getAnalysisUsage(AnalysisUsage &AU) const {
 			AU.addRequired<LoopInfoWrapperPass>();
+			if (Hotness)
+				AU.addRequired<BlockFrequencyInfoWrapperPass>();
 			AU.setPreservesAll();
 		}
 
-		void count_loops(Loop *L) {
-			loop_count++;
-			std::vector<Loop *> subloops = L->getSubLoops();
-			for (Loop::iterator sub = subloops.begin(); sub != subloops.end(); sub++) {
-				//loop_count++;
-				count_loops(*sub);
-			}
+		bool doInitialization(Module &M) override {
+			hot.limit = HotLoopCount;
+			return false;
 		}
 
 		bool runOnFunction(Function &F) override {
 			LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
-			for (LoopInfo::iterator loop = LI.begin(); loop != LI.end(); loop++) {
-				count_loops(*loop);
+			BlockFrequencyInfo *BFI = NULL;
+			double func_freq = 0;
+			if (Hotness) {
+				BFI = &getAnalysis<BlockFrequencyInfoWrapperPass>().getBFI();
+				func_freq = function_freq(F, *BFI);
+			}
+			if (!BFI) {
+				loop_count += count_all_loops(LI);
+				return false;
 			}
+			for_each_loop(LI, [&](Loop *L) {
+				loop_count++;
+				HotLoop hl = loop_heat(F, L, LI, *BFI, func_freq);
+				hot.insert(hl);
+				errs() << F.getName() << ": loop " << hl.header << " (depth " << hl.depth
+				       << "): share = " << format("%.1f", hl.share * 100) << "%, own blocks "
+				       << format("%.1f", hl.self_share * 100) << "%\n";
+			});
 			return false;
 		}
 
@@ -475,6 +1178,8 @@ namespace {
 			std::cout << "------------------------------\n";
 			std::cout << "Summary:\n";
 			std::cout << "All loop count: " << loop_count << "\n";
+			if (Hotness)
+				print_hot_loops(hot);
 			return false;
 		}
 	};
@@ -482,9 +1187,101 @@ namespace {
 
 char AllLoops::ID = 0;
 int AllLoops::loop_count;
+TopN<HotLoop> AllLoops::hot;
 static RegisterPass<AllLoops> E("allloops", "number of all loops");
 
 
+/* 3.1.1b) Loop-nest census: one walk over the LoopInfo forest recording
+ * per-loop shape and ScalarEvolution trip counts, to spot vectorization and
+ * unrolling candidates */
+namespace {
+	struct LoopNest : public FunctionPass {
+		static char ID;
+		static int loop_count;
+		static int innermost;
+		static int const_trip;	/* exact constant trip count */
+		static int max_trip;	/* only a constant upper bound */
+		static int candidates;	/* innermost, single exiting block, known trip count */
+		static std::map<unsigned, int> depths;
+		LoopNest() : FunctionPass(ID) {}
+
+		void getAnalysisUsage(AnalysisUsage &AU) const {
+			AU.addRequired<LoopInfoWrapperPass>();
+			AU.addRequired<ScalarEvolutionWrapperPass>();
+			AU.setPreservesAll();
+		}
+
+		bool runOnFunction(Function &F) override {
+			LoopInfo &LI = getAnalysis<LoopInfoWrapperPass>().getLoopInfo();
+			ScalarEvolution &SE = getAnalysis<ScalarEvolutionWrapperPass>().getSE();
+
+			SmallVector<BasicBlock *, 8> exiting;
+			SmallVector<Loop::Edge, 8> exits;
+			for_each_loop(LI, [&](Loop *L) {
+				exiting.clear();
+				exits.clear();
+				L->getExitingBlocks(exiting);
+				L->getExitEdges(exits);
+				unsigned trip = SE.getSmallConstantTripCount(L);
+				unsigned max = SE.getSmallConstantMaxTripCount(L);
+				bool inner = L->getSubLoops().empty();
+				bool candidate = inner && exiting.size() == 1 && (trip != 0 || max != 0);
+
+				loop_count++;
+				depths[L->getLoopDepth()]++;
+				if (inner)
+					innermost++;
+				if (trip != 0)
+					const_trip++;
+				else if (max != 0)
+					max_trip++;
+				if (candidate)
+					candidates++;
+
+				errs() << F.getName() << ": loop " << L->getHeader()->getName()
+				       << " depth " << L->getLoopDepth()
+				       << ", #BBs = " << L->getNumBlocks()
+				       << ", exiting = " << exiting.size()
+				       << ", exit edges = " << exits.size()
+				       << ", trip count = ";
+				if (trip != 0)
+					errs() << trip;
+				else if (max != 0)
+					errs() << "<= " << max;
+				else
+					errs() << "?";
+				if (candidate)
+					errs() << " [candidate]";
+				errs() << "\n";
+			});
+			return false;
+		}
+
+		bool doFinalization(Module &M) override {
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			std::cout << "loops: " << loop_count << "\n";
+			for (std::map<unsigned, int>::iterator it = depths.begin(); it != depths.end(); it++)
+				std::cout << "  depth " << it->first << ": " << it->second << "\n";
+			std::cout << "innermost loops: " << innermost << "\n";
+			std::cout << "constant trip count: " << const_trip << "\n";
+			std::cout << "constant max trip count only: " << max_trip << "\n";
+			std::cout << "unknown trip count: " << loop_count - const_trip - max_trip << "\n";
+			std::cout << "vectorize/unroll candidates: " << candidates << "\n";
+			return false;
+		}
+	};
+}
+
+char LoopNest::ID = 0;
+int LoopNest::loop_count;
+int LoopNest::innermost;
+int LoopNest::const_trip;
+int LoopNest::max_trip;
+int LoopNest::candidates;
+std::map<unsigned, int> LoopNest::depths;
+static RegisterPass<LoopNest> I("loopnest", "loop-nest census with trip counts");
+
 /* 3.1.2) */
 namespace {
 	struct OuterLoops : public FunctionPass {
@@ -593,10 +1390,122 @@ static RegisterPass<LoopExitEdges> D("lee", "loop exit edge count");
 
 
 /* 3.2: Warshall's algorithm  */
+typedef std::map<BasicBlock *, std::map<BasicBlock *, int> > DistTable;
+typedef std::map<BasicBlock *, std::map<BasicBlock *, BasicBlock *> > NextTable;
+
+static void warshall_init(Function &F, int INF, DistTable &dist, NextTable &next) {
+	for (Function::iterator bb = F.begin(), bb_end = F.end(); bb != bb_end; bb++) {
+		BasicBlock &blk = *bb;
+		const TerminatorInst *TInst = blk.getTerminator();
+		for (Function::iterator bb_in = F.begin(), bb_in_end = F.end(); bb_in != bb_in_end; bb_in++) {
+			BasicBlock &blk_in = *bb_in;
+			if (&blk == &blk_in)
+				dist[&blk][&blk_in] = 0;
+			else
+				//dist[&blk][&blk_in] = -1;
+				dist[&blk][&blk_in] = INF;
+			next[&blk][&blk_in] = NULL;
+		}
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+			BasicBlock *succ = TInst->getSuccessor(i);
+			dist[&blk][succ] = 1;
+			next[&blk][succ] = succ;
+		}
+	}
+}
+
+/* reference: Floyd-Warshall straight on the maps */
+static void warshall_relax(Function &F, DistTable &dist, NextTable &next) {
+	for (Function::iterator k = F.begin(), k_end = F.end(); k != k_end; k++) {
+		BasicBlock &blk_k = *k;
+		for (Function::iterator i = F.begin(), i_end = F.end(); i != i_end; i++) {
+			BasicBlock &blk_i = *i;
+			for (Function::iterator j = F.begin(), j_end = F.end(); j != j_end; j++) {
+				BasicBlock &blk_j = *j;
+				if (dist[&blk_i][&blk_j] > dist[&blk_i][&blk_k] + dist[&blk_k][&blk_j]) {
+					// errs() << dist[&blk_i][&blk_j] << ", " << dist[&blk_i][&blk_k] << ", " << dist[&blk_k][&blk_j] << "\n";
+					dist[&blk_i][&blk_j] = dist[&blk_i][&blk_k] + dist[&blk_k][&blk_j];
+					next[&blk_i][&blk_j] = next[&blk_i][&blk_k];
+				}
+			}
+		}
+	}
+}
+
+/* The tables as flat n x n arrays in layout order; next holds the id of the
+ * next block, -1 for none. */
+namespace {
+	struct DenseTables {
+		std::vector<BasicBlock *> blocks;
+		std::vector<int> dist;
+		std::vector<int> next;
+
+		DenseTables(Function &F, DistTable &dist_map, NextTable &next_map) {
+			DenseMap<const BasicBlock *, unsigned> ids;
+			number_blocks(F, ids);
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+				blocks.push_back(&*bb);
+			unsigned n = blocks.size();
+			dist.resize(n * n);
+			next.resize(n * n);
+			for (unsigned i = 0; i < n; i++)
+				for (unsigned j = 0; j < n; j++) {
+					dist[i * n + j] = dist_map[blocks[i]][blocks[j]];
+					BasicBlock *to = next_map[blocks[i]][blocks[j]];
+					next[i * n + j] = to ? (int)ids[to] : -1;
+				}
+		}
+
+		void store(DistTable &dist_map, NextTable &next_map) const {
+			unsigned n = blocks.size();
+			for (unsigned i = 0; i < n; i++)
+				for (unsigned j = 0; j < n; j++) {
+					dist_map[blocks[i]][blocks[j]] = dist[i * n + j];
+					next_map[blocks[i]][blocks[j]] = next[i * n + j] < 0 ? NULL : blocks[next[i * n + j]];
+				}
+		}
+	};
+}
+
+/* Floyd-Warshall over the flat arrays, rows split across threads. Row k and
+ * column k don't change during step k, so rows are independent within a step
+ * and the result is identical to warshall_relax(). */
+static void relax_dense(unsigned n, unsigned threads, std::vector<int> &d, std::vector<int> &nx) {
+	ParallelPool pool(std::min(threads, std::max(1u, n)));
+	for (unsigned k = 0; k < n; k++) {
+		const int *row_k = &d[k * n];
+		pool.run(n, [&](unsigned i, unsigned) {
+			int *row_i = &d[i * n];
+			int ik = row_i[k];
+			int next_ik = nx[i * n + k];
+			for (unsigned j = 0; j < n; j++)
+				if (row_i[j] > ik + row_k[j]) {
+					row_i[j] = ik + row_k[j];
+					nx[i * n + j] = next_ik;
+				}
+		});
+	}
+}
+
+/* same relaxation as warshall_relax(), through the flat arrays */
+static void warshall_relax_dense(Function &F, unsigned threads, DistTable &dist, NextTable &next) {
+	DenseTables tables(F, dist, next);
+	relax_dense(tables.blocks.size(), threads, tables.dist, tables.next);
+	tables.store(dist, next);
+}
+
+static void print_scaling(const char *what, Function &F, const std::vector<double> &ms) {
+	errs() << "closure-bench " << what << " " << F.getName() << " (" << F.size() << " blocks):";
+	for (unsigned i = 0, t = 1; i < ms.size(); i++, t *= 2)
+		errs() << " " << t << "t " << format("%.2f", ms[i]) << "ms (x" << format("%.2f", ms[0] / ms[i]) << ")";
+	errs() << "\n";
+}
+
 namespace {
 	struct Warshall : public FunctionPass {
 		static char ID;
 		static int total_loops;
+		static int skipped;
 		static int INF;
 		Warshall() : FunctionPass(ID) {}
 
@@ -687,29 +1596,77 @@ namespace {
 			return false;
 		}
 
+		/* Path reconstruction visits every pair (a, b) on a common cycle,
+		 * i.e. n_C^2 pairs per cyclic SCC C. Each pair builds its cycle
+		 * (~n_C blocks) and in_set() compares it against every stored
+		 * path; about one pair in eight yields a new path, which then
+		 * scans all of F per path block. Fitted on single-SCC CFGs of
+		 * 120 to 360 blocks, where runtime grows ~n^4. */
+		static double reconstruction_ops(Function &F, double &bytes) {
+			double n = F.size();
+			double pairs = 0, walks = 0;
+			bytes = 0;
+			for (scc_iterator<Function *> scc = scc_begin(&F); !scc.isAtEnd(); ++scc) {
+				if (!scc.hasLoop())
+					continue;
+				double size = (*scc).size();
+				pairs += size * size;
+				walks += size * size / 8 * size * n;
+				bytes += size * size / 8 * 2 * size * sizeof(void *);
+			}
+			return pairs * pairs / 8 + walks;
+		}
+
+		/* times relax_dense() on 1 to 64 threads, from flat tables built
+		 * once; seven more relaxations, so they must fit the budget too */
+		void bench(Function &F, const Variant &chosen, DistTable &dist, NextTable &next) {
+			double n = F.size();
+			double ops = 7 * (n * n * n + 2 * n * n);
+			double bytes = 4 * n * n * sizeof(int);
+			if (!fits_budget(chosen.ops + ops, chosen.bytes + bytes, chosen.ns + 2.5 * ops)) {
+				errs() << "[budget] warshall: no closure-bench for " << F.getName()
+				       << ", it needs another ~" << format("%.3g", 2.5 * ops / 1e9) << " s\n";
+				return;
+			}
+			DenseTables tables(F, dist, next);
+			std::vector<double> ms;
+			for (unsigned t = 1; t <= 64; t *= 2) {
+				std::vector<int> d = tables.dist, nx = tables.next;
+				ms.push_back(time_ns([&] { relax_dense(F.size(), t, d, nx); }) / 1e6);
+			}
+			print_scaling("warshall dense", F, ms);
+		}
+
 		bool runOnFunction(Function &F) override {
-			std::map<BasicBlock *, std::map<BasicBlock *, int> > dist;
-			std::map<BasicBlock *, std::map<BasicBlock *, BasicBlock *> > next;
+			/* n^3 relaxations (on the maps, or on dense arrays after copying
+			 * the maps over), then path reconstruction; dist and next hold
+			 * n^2 map nodes each, and every table is printed and scanned
+			 * about four times (tables) */
+			double n = F.size();
+			double init = n * n * std::log2(n + 1);
+			double tables = 4 * init;
+			double map_relax = n * n * n * std::log2(n + 1);
+			double dense_relax = n * n * n + 2 * init;
+			double path_bytes;
+			double rebuild = reconstruction_ops(F, path_bytes);
+			std::vector<Variant> variants;
+			variants.push_back({"reference", init + tables + map_relax + rebuild,
+					    2 * n * n * 48 + path_bytes,
+					    30 * init + 60 * tables + 30 * map_relax + 7 * rebuild});
+			variants.push_back({"dense", init + tables + dense_relax + rebuild,
+					    2 * n * n * 48 + 2 * n * n * sizeof(int) + path_bytes,
+					    30 * init + 60 * tables + 2.5 * dense_relax + 7 * rebuild});
+			int v = pick_variant("warshall", F, variants);
+			if (v < 0) {
+				skipped++;
+				return false;
+			}
+
+			DistTable dist;
+			NextTable next;
 
 			// init
-			for (Function::iterator bb = F.begin(), bb_end = F.end(); bb != bb_end; bb++) {
-				BasicBlock &blk = *bb;
-				const TerminatorInst *TInst = blk.getTerminator();
-				for (Function::iterator bb_in = F.begin(), bb_in_end = F.end(); bb_in != bb_in_end; bb_in++) {
-					BasicBlock &blk_in = *bb_in;
-					if (&blk == &blk_in)
-						dist[&blk][&blk_in] = 0;
-					else
-						//dist[&blk][&blk_in] = -1;
-						dist[&blk][&blk_in] = INF;
-					next[&blk][&blk_in] = NULL;
-				}
-				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
-					BasicBlock *succ = TInst->getSuccessor(i);
-					dist[&blk][succ] = 1;
-					next[&blk][succ] = succ;
-				}
-			}
+			warshall_init(F, INF, dist, next);
 
 			errs() << "right after init:\n";
 			errs() << "dist table:\n";
@@ -717,20 +1674,12 @@ namespace {
 			errs() << "next table:\n";
 			print_next_table(next);
 
-			for (Function::iterator k = F.begin(), k_end = F.end(); k != k_end; k++) {
-				BasicBlock &blk_k = *k;
-				for (Function::iterator i = F.begin(), i_end = F.end(); i != i_end; i++) {
-					BasicBlock &blk_i = *i;
-					for (Function::iterator j = F.begin(), j_end = F.end(); j != j_end; j++) {
-						BasicBlock &blk_j = *j;
-						if (dist[&blk_i][&blk_j] > dist[&blk_i][&blk_k] + dist[&blk_k][&blk_j]) {
-							// errs() << dist[&blk_i][&blk_j] << ", " << dist[&blk_i][&blk_k] << ", " << dist[&blk_k][&blk_j] << "\n";
-							dist[&blk_i][&blk_j] = dist[&blk_i][&blk_k] + dist[&blk_k][&blk_j];
-							next[&blk_i][&blk_j] = next[&blk_i][&blk_k];
-						}
-					}
-				}
-			}
+			if (ClosureBench)
+				bench(F, variants[v], dist, next);
+			if (v == 0)
+				warshall_relax(F, dist, next);
+			else
+				warshall_relax_dense(F, closure_threads(F), dist, next);
 
 			errs() << "right after Warshall's:\n";
 			errs() << "dist table:\n";
@@ -863,6 +1812,7 @@ namespace {
 			std::cout << "------------------------------\n";
 			std::cout << "Summary:\n";
 			errs() << "total loops: " << total_loops << "\n";
+			std::cout << "functions skipped (over budget): " << skipped << "\n";
 			// std::cout << "single entry loops detected: " << sel << "\n";
 			// std::cout << "multi entry loops detected: " << mel << "\n";
 			return false;
@@ -872,126 +1822,2134 @@ namespace {
 
 char Warshall::ID = 0;
 int Warshall::total_loops;
+int Warshall::skipped;
 int Warshall::INF = 99999;
 static RegisterPass<Warshall> G("warshall", "warshall impl");
 
-/* 3.3: Control dependence */
+/* 3.2b: Ball-Larus acyclic path count, a linear-time path complexity metric.
+ * Back edges found by a DFS from the entry are replaced by dummy edges
+ * ENTRY->header and latch->EXIT, and paths are counted in one pass over the
+ * DFS postorder (a reverse topological order of what is left). */
+static uint64_t sat_add(uint64_t a, uint64_t b) {
+	uint64_t sum = a + b;
+	return sum < a ? std::numeric_limits<uint64_t>::max() : sum;
+}
+
+/* returns the number of acyclic paths of F, saturated at UINT64_MAX */
+static uint64_t ball_larus_paths(Function &F) {
+	DenseMap<const BasicBlock *, unsigned> ids;
+	number_blocks(F, ids);
+	enum { WHITE, ON_STACK, DONE };
+	std::vector<char> color(F.size(), WHITE);
+	std::vector<uint64_t> num_paths(F.size(), 0);
+	std::vector<std::pair<BasicBlock *, unsigned> > stack;
+	std::vector<std::pair<unsigned, unsigned> > back_edges;
+
+	BasicBlock *entry = &F.getEntryBlock();
+	stack.push_back(std::make_pair(entry, 0));
+	color[ids[entry]] = ON_STACK;
+	while (!stack.empty()) {
+		BasicBlock *blk = stack.back().first;
+		unsigned succ_idx = stack.back().second;
+		const TerminatorInst *TInst = blk->getTerminator();
+		if (succ_idx < TInst->getNumSuccessors()) {
+			stack.back().second++;
+			BasicBlock *succ = TInst->getSuccessor(succ_idx);
+			unsigned id = ids[succ];
+			if (color[id] == WHITE) {
+				color[id] = ON_STACK;
+				stack.push_back(std::make_pair(succ, 0));
+			} else if (color[id] == ON_STACK) {
+				back_edges.push_back(std::make_pair(ids[blk], id));
+			}
+			continue;
+		}
+
+		/* postorder: every non-back successor is already counted */
+		unsigned id = ids[blk];
+		uint64_t paths = TInst->getNumSuccessors() == 0 ? 1 : 0;
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+			unsigned succ = ids[TInst->getSuccessor(i)];
+			if (color[succ] == ON_STACK)
+				paths = sat_add(paths, 1); /* dummy latch->EXIT edge */
+			else
+				paths = sat_add(paths, num_paths[succ]);
+		}
+		num_paths[id] = paths;
+		color[id] = DONE;
+		stack.pop_back();
+	}
+
+	uint64_t total = num_paths[ids[entry]];
+	for (unsigned i = 0; i < back_edges.size(); i++)
+		total = sat_add(total, num_paths[back_edges[i].second]); /* dummy ENTRY->header edge */
+	return total;
+}
+
 namespace {
-	struct ControlDep : public FunctionPass {
+	struct AcyclicPaths : public FunctionPass {
 		static char ID;
 		static int func_count;
-		//static std::map<BasicBlock *, std::vector<BasicBlock> > cdmap;
-		ControlDep() : FunctionPass(ID) {}
-
-		void getAnalysisUsage(AnalysisUsage &AU) const {
-			AU.addRequired<PostDominatorTree>();
-			AU.setPreservesAll();
-		}
+		static int saturated;
+		static uint64_t max;
+		static uint64_t min;
+		static double sum;
+		AcyclicPaths() : FunctionPass(ID) {}
 
 		bool runOnFunction(Function &F) override {
+			uint64_t paths = ball_larus_paths(F);
+			bool sat = paths == std::numeric_limits<uint64_t>::max();
+			errs() << "acyclic paths in " << F.getName() << ": " << paths
+			       << (sat ? " (saturated)" : "") << "\n";
+			if (func_count == 0 || paths > max)
+				max = paths;
+			if (func_count == 0 || paths < min)
+				min = paths;
+			sum += paths;
 			func_count++;
-			PostDominatorTree *PDT = &getAnalysis<PostDominatorTree>();
-			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
-				BasicBlock &B1 = *bb;
-				//errs() << blk.getName() << ": ";
-				//std::vector<BasicBlock> list;
-				errs() << "Basic Blocks that are control dependent on " << *B1.getFirstNonPHI() << "={";
-				for (Function::iterator bb_tail = F.begin(); bb_tail != F.end(); bb_tail++) {
-					BasicBlock &B2 = *bb_tail;
-					if (!PDT->dominates(&B2, &B1)) {
-						const TerminatorInst *TInst = B1.getTerminator();
-						for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
-							BasicBlock *succ = TInst->getSuccessor(i);
-							if (PDT->dominates(&B2, succ)) {
-								errs() << *B2.getFirstNonPHI() << ", ";
-								//errs() << B2.getName() << "\n";
-								break;
-							}
-						}
-						//list.push_back(blk_tail);
-					}
-					//errs() << "}\n";
-				}
-				errs() << "}\n";
-
-				//cdmap[&blk] = list;
-			}
+			if (sat)
+				saturated++;
 			return false;
 		}
 
 		bool doFinalization(Module &M) override {
 			std::cout << "------------------------------\n";
 			std::cout << "Summary:\n";
+			std::cout << "Max: " << max << "\n";
+			std::cout << "Min: " << min << "\n";
+			std::cout << "Average: " << (func_count ? sum / func_count : -1) << "\n";
+			std::cout << "functions: " << func_count << "\n";
+			std::cout << "saturated at 2^64-1: " << saturated << "\n";
 			return false;
 		}
 	};
 }
 
-char ControlDep::ID = 0;
-int ControlDep::func_count;
-//std::map<BasicBlock *, std::vector<BasicBlock> > ControlDep::cdmap;
+char AcyclicPaths::ID = 0;
+int AcyclicPaths::func_count;
+int AcyclicPaths::saturated;
+uint64_t AcyclicPaths::max;
+uint64_t AcyclicPaths::min;
+double AcyclicPaths::sum;
+static RegisterPass<AcyclicPaths> J("paths", "Ball-Larus acyclic path count");
+
+/* 3.3: Control dependence */
+
+/* reference: B2 is control dependent on B1 if B2 post-dominates a successor of
+ * B1 but not B1 itself; checks every pair, O(n^2 * succs) */
+template <typename PostDomTree>
+static void cdep_pairwise(Function &F, PostDomTree &PDT, std::vector<std::vector<BasicBlock *> > &deps) {
+	deps.assign(F.size(), std::vector<BasicBlock *>());
+	unsigned b1_id = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++, b1_id++) {
+		BasicBlock &B1 = *bb;
+		for (Function::iterator bb_tail = F.begin(); bb_tail != F.end(); bb_tail++) {
+			BasicBlock &B2 = *bb_tail;
+			if (!PDT.dominates(&B2, &B1)) {
+				const TerminatorInst *TInst = B1.getTerminator();
+				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+					BasicBlock *succ = TInst->getSuccessor(i);
+					if (PDT.dominates(&B2, succ)) {
+						deps[b1_id].push_back(&B2);
+						break;
+					}
+				}
+			}
+		}
+	}
+}
+
+/* Same sets by walking up the post-dominator tree from each successor of B1
+ * until reaching a post-dominator of B1 (Ferrante et al.); costs the total
+ * length of those walks. Only valid when every block has a tree node. */
+template <typename PostDomTree>
+static void cdep_walk(Function &F, PostDomTree &PDT, std::vector<std::vector<BasicBlock *> > &deps) {
+	DenseMap<const BasicBlock *, unsigned> ids;
+	number_blocks(F, ids);
+	std::vector<unsigned> stamp(F.size(), 0);
+	deps.assign(F.size(), std::vector<BasicBlock *>());
+	unsigned b1_id = 0;
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++, b1_id++) {
+		BasicBlock &B1 = *bb;
+		DomTreeNode *N1 = PDT.getNode(&B1);
+		std::vector<BasicBlock *> &list = deps[b1_id];
+		const TerminatorInst *TInst = B1.getTerminator();
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+			for (DomTreeNode *N = PDT.getNode(TInst->getSuccessor(i)); N && N->getBlock(); N = N->getIDom()) {
+				if (PDT.dominates(N, N1))
+					break;
+				unsigned id = ids[N->getBlock()];
+				/* an earlier successor's walk already covered the rest of this path */
+				if (stamp[id] == b1_id + 1)
+					break;
+				stamp[id] = b1_id + 1;
+				list.push_back(N->getBlock());
+			}
+		}
+		/* report in layout order, like the pairwise version */
+		std::sort(list.begin(), list.end(), [&ids](BasicBlock *a, BasicBlock *b) {
+			return ids[a] < ids[b];
+		});
+	}
+}
+
+namespace {
+	struct ControlDep : public FunctionPass {
+		static char ID;
+		static int func_count;
+		static int skipped;
+		ControlDep() : FunctionPass(ID) {}
+
+		void getAnalysisUsage(AnalysisUsage &AU) const {
+			AU.addRequired<PostDominatorTree>();
+			AU.setPreservesAll();
+		}
+
+		bool runOnFunction(Function &F) override {
+			func_count++;
+			PostDominatorTree *PDT = &getAnalysis<PostDominatorTree>();
+
+			/* the walk costs the sum of the successors' post-dominator depths */
+			DenseMap<const BasicBlock *, unsigned> depth;
+			for (df_iterator<DomTreeNode *> node = df_begin(PDT->getRootNode()),
+				     node_end = df_end(PDT->getRootNode()); node != node_end; ++node)
+				if (node->getBlock())
+					depth[node->getBlock()] = node.getPathLength();
+			double n = F.size();
+			double e = count_edges(F);
+			double walk_ops = 0;
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+				const TerminatorInst *TInst = bb->getTerminator();
+				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++)
+					walk_ops += depth.lookup(TInst->getSuccessor(i));
+			}
+
+			std::vector<Variant> variants;
+			variants.push_back({"pairwise", n * (n + e), n * sizeof(void *), 11 * n * (n + e)});
+			if (depth.size() == F.size())
+				variants.push_back({"pdt-walk", walk_ops + n, 3 * n * sizeof(void *), 30 * (walk_ops + n)});
+			int v = pick_variant("cdep", F, variants);
+			if (v < 0) {
+				skipped++;
+				return false;
+			}
+
+			std::vector<std::vector<BasicBlock *> > deps;
+			if (v == 0)
+				cdep_pairwise(F, *PDT, deps);
+			else
+				cdep_walk(F, *PDT, deps);
+
+			unsigned b1_id = 0;
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++, b1_id++) {
+				BasicBlock &B1 = *bb;
+				errs() << "Basic Blocks that are control dependent on " << *B1.getFirstNonPHI() << "={";
+				for (BasicBlock *B2 : deps[b1_id])
+					errs() << *B2->getFirstNonPHI() << ", ";
+				errs() << "}\n";
+			}
+			return false;
+		}
+
+		bool doFinalization(Module &M) override {
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			std::cout << "functions skipped (over budget): " << skipped << "\n";
+			return false;
+		}
+	};
+}
+
+char ControlDep::ID = 0;
+int ControlDep::func_count;
+int ControlDep::skipped;
 static RegisterPass<ControlDep> F("cdep", "Control dependence");
 
 /* 3.4: Reachability */
+
+/* reference: can B be reached from A along at least one edge */
+static bool reach_bfs(BasicBlock *A, BasicBlock *B) {
+	std::queue<BasicBlock *> q;
+	std::map<BasicBlock *, bool> visited;
+	q.push(A);
+
+	while (q.size() > 0) {
+		BasicBlock *blk = q.front();
+		q.pop();
+		visited[blk] = true;
+		const TerminatorInst *TInst = blk->getTerminator();
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+			BasicBlock *succ = TInst->getSuccessor(i);
+			if (succ == B)
+				return true;
+			else if (visited.count(succ) != 1)
+				q.push(succ);
+		}
+	}
+	return false;
+}
+
+/* reference: one BFS per pair, returns the number of reachable pairs */
+static uint64_t reach_pairwise(Function &F) {
+	uint64_t reachable = 0;
+	for (Function::iterator bb = F.begin(), bb_end = F.end(); bb != bb_end; bb++) {
+		BasicBlock &b1 = *bb;
+		for (Function::iterator bb_in = F.begin(), bb_in_end = F.end(); bb_in != bb_in_end; bb_in++) {
+			BasicBlock &b2 = *bb_in;
+			if (reach_bfs(&b1, &b2))
+				reachable++;
+		}
+	}
+	return reachable;
+}
+
+/* Single-pair reachability. Blocks get dense ids and the CFG is flattened
+ * into successor/predecessor arrays once per function; each query then runs
+ * a bidirectional BFS, always growing the smaller frontier, over visited
+ * arrays stamped with a per-query epoch, so repeated queries allocate nothing. */
+namespace {
+	struct ReachIndex {
+		DenseMap<const BasicBlock *, unsigned> ids;
+		std::vector<unsigned> succ_start, succs;	/* CSR: succs of i in [succ_start[i], succ_start[i+1]) */
+		std::vector<unsigned> pred_start, preds;
+		std::vector<unsigned> fwd_seen, bwd_seen;
+		std::vector<unsigned> fwd, bwd, next;
+		unsigned epoch;
+
+		unsigned size() const { return succ_start.size() - 1; }
+
+		ReachIndex(Function &F) : epoch(0) {
+			number_blocks(F, ids);
+			unsigned n = F.size();
+			std::vector<unsigned> pred_count(n + 1, 0);
+			succ_start.push_back(0);
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+				const TerminatorInst *TInst = bb->getTerminator();
+				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+					unsigned id = ids[TInst->getSuccessor(i)];
+					succs.push_back(id);
+					pred_count[id + 1]++;
+				}
+				succ_start.push_back(succs.size());
+			}
+			pred_start.assign(n + 1, 0);
+			for (unsigned i = 0; i < n; i++)
+				pred_start[i + 1] = pred_start[i] + pred_count[i + 1];
+			preds.resize(succs.size());
+			std::vector<unsigned> fill(pred_start.begin(), pred_start.end() - 1);
+			for (unsigned from = 0; from < n; from++)
+				for (unsigned e = succ_start[from]; e < succ_start[from + 1]; e++)
+					preds[fill[succs[e]]++] = from;
+			fwd_seen.assign(n, 0);
+			bwd_seen.assign(n, 0);
+			fwd.reserve(n);
+			bwd.reserve(n);
+			next.reserve(n);
+		}
+
+		/* can b be reached from a along at least one edge, like reach_bfs() */
+		bool query(unsigned a, unsigned b) {
+			if (++epoch == 0) {
+				std::fill(fwd_seen.begin(), fwd_seen.end(), 0);
+				std::fill(bwd_seen.begin(), bwd_seen.end(), 0);
+				epoch = 1;
+			}
+			/* fwd holds blocks reached from a by >= 1 edge, bwd blocks reaching b by >= 0 */
+			fwd.clear();
+			bwd.clear();
+			bwd_seen[b] = epoch;
+			bwd.push_back(b);
+			for (unsigned e = succ_start[a]; e < succ_start[a + 1]; e++) {
+				unsigned s = succs[e];
+				if (bwd_seen[s] == epoch)
+					return true;
+				if (fwd_seen[s] != epoch) {
+					fwd_seen[s] = epoch;
+					fwd.push_back(s);
+				}
+			}
+			while (!fwd.empty() && !bwd.empty()) {
+				bool forward = fwd.size() <= bwd.size();
+				if (forward ? expand(fwd, succ_start, succs, fwd_seen, bwd_seen)
+				    : expand(bwd, pred_start, preds, bwd_seen, fwd_seen))
+					return true;
+			}
+			return false;
+		}
+
+		/* advances one BFS level; true once it touches the other side */
+		bool expand(std::vector<unsigned> &frontier, const std::vector<unsigned> &start,
+			    const std::vector<unsigned> &adj, std::vector<unsigned> &seen,
+			    const std::vector<unsigned> &other) {
+			next.clear();
+			for (unsigned i = 0; i < frontier.size(); i++) {
+				unsigned u = frontier[i];
+				for (unsigned e = start[u]; e < start[u + 1]; e++) {
+					unsigned v = adj[e];
+					if (seen[v] == epoch)
+						continue;
+					if (other[v] == epoch)
+						return true;
+					seen[v] = epoch;
+					next.push_back(v);
+				}
+			}
+			frontier.swap(next);
+			return false;
+		}
+	};
+}
+
+/* Same answers as reach_pairwise() with one BFS per source over the index,
+ * sources split across threads, each worker with its own visited stamps. */
+static uint64_t reach_per_source(ReachIndex &index, unsigned threads) {
+	unsigned n = index.size();
+	threads = std::max(1u, std::min(threads, n));
+	std::vector<std::vector<unsigned> > seen(threads, std::vector<unsigned>(n, 0));
+	std::vector<std::vector<unsigned> > queue(threads);
+	std::vector<uint64_t> reachable(threads, 0);
+	parallel_for(n, threads, [&](unsigned source, unsigned w) {
+		/* source + 1 is unique per BFS, so it doubles as the epoch */
+		unsigned epoch = source + 1;
+		std::vector<unsigned> &q = queue[w];
+		q.clear();
+		q.push_back(source);
+		/* the source itself only counts if it sits on a cycle; count
+		 * locally so workers don't share a cache line per edge */
+		uint64_t count = 0;
+		for (unsigned head = 0; head < q.size(); head++) {
+			unsigned u = q[head];
+			for (unsigned e = index.succ_start[u]; e < index.succ_start[u + 1]; e++) {
+				unsigned v = index.succs[e];
+				if (seen[w][v] == epoch)
+					continue;
+				seen[w][v] = epoch;
+				count++;
+				q.push_back(v);
+			}
+		}
+		reachable[w] += count;
+	});
+	uint64_t total = 0;
+	for (unsigned w = 0; w < threads; w++)
+		total += reachable[w];
+	return total;
+}
+
+/* Transitive closure over the condensation DAG. Tarjan's algorithm numbers
+ * the SCCs sinks first; each SCC C then gets its closed reach set
+ * S(C) = members(C) + S(D) for every successor SCC D. SCCs on the same DAG
+ * level only read lower levels, so each level is split across threads. */
+namespace {
+	struct SCCClosure {
+		std::vector<unsigned> comp;	/* block -> SCC */
+		std::vector<std::vector<unsigned> > members;
+		std::vector<bool> cyclic;	/* more than one block, or a self-loop */
+		std::vector<std::vector<unsigned> > levels;
+		std::vector<BitVector> closed;
+
+		SCCClosure(const ReachIndex &index) {
+			unsigned n = index.size();
+			const unsigned UNVISITED = ~0u;
+			std::vector<unsigned> order(n, UNVISITED), low(n);
+			std::vector<bool> on_stack(n, false);
+			std::vector<unsigned> stack;
+			std::vector<std::pair<unsigned, unsigned> > calls;
+			unsigned counter = 0;
+			comp.assign(n, 0);
+			for (unsigned root = 0; root < n; root++) {
+				if (order[root] != UNVISITED)
+					continue;
+				calls.push_back(std::make_pair(root, index.succ_start[root]));
+				order[root] = low[root] = counter++;
+				stack.push_back(root);
+				on_stack[root] = true;
+				while (!calls.empty()) {
+					unsigned v = calls.back().first;
+					unsigned e = calls.back().second;
+					if (e < index.succ_start[v + 1]) {
+						calls.back().second++;
+						unsigned w = index.succs[e];
+						if (order[w] == UNVISITED) {
+							order[w] = low[w] = counter++;
+							stack.push_back(w);
+							on_stack[w] = true;
+							calls.push_back(std::make_pair(w, index.succ_start[w]));
+						} else if (on_stack[w]) {
+							low[v] = std::min(low[v], order[w]);
+						}
+						continue;
+					}
+					calls.pop_back();
+					if (!calls.empty())
+						low[calls.back().first] = std::min(low[calls.back().first], low[v]);
+					if (low[v] != order[v])
+						continue;
+					unsigned c = members.size();
+					members.push_back(std::vector<unsigned>());
+					unsigned w;
+					do {
+						w = stack.back();
+						stack.pop_back();
+						on_stack[w] = false;
+						comp[w] = c;
+						members[c].push_back(w);
+					} while (w != v);
+				}
+			}
+
+			/* successor SCCs always have smaller numbers */
+			std::vector<unsigned> level(members.size(), 0);
+			cyclic.assign(members.size(), false);
+			for (unsigned c = 0; c < members.size(); c++) {
+				cyclic[c] = members[c].size() > 1;
+				for (unsigned m = 0; m < members[c].size(); m++) {
+					unsigned u = members[c][m];
+					for (unsigned e = index.succ_start[u]; e < index.succ_start[u + 1]; e++) {
+						unsigned d = comp[index.succs[e]];
+						if (d == c)
+							cyclic[c] = true;
+						else
+							level[c] = std::max(level[c], level[d] + 1);
+					}
+				}
+				if (level[c] >= levels.size())
+					levels.resize(level[c] + 1);
+				levels[level[c]].push_back(c);
+			}
+		}
+
+		void run(const ReachIndex &index, unsigned threads) {
+			unsigned n = comp.size();
+			closed.assign(members.size(), BitVector());
+			ParallelPool pool(threads);
+			for (unsigned l = 0; l < levels.size(); l++) {
+				const std::vector<unsigned> &level = levels[l];
+				pool.run(level.size(), [&](unsigned t, unsigned) {
+					unsigned c = level[t];
+					BitVector &S = closed[c];
+					S.resize(n);
+					std::vector<unsigned> succ_comps;
+					for (unsigned m = 0; m < members[c].size(); m++) {
+						unsigned u = members[c][m];
+						S.set(u);
+						for (unsigned e = index.succ_start[u]; e < index.succ_start[u + 1]; e++)
+							if (comp[index.succs[e]] != c)
+								succ_comps.push_back(comp[index.succs[e]]);
+					}
+					std::sort(succ_comps.begin(), succ_comps.end());
+					succ_comps.erase(std::unique(succ_comps.begin(), succ_comps.end()), succ_comps.end());
+					for (unsigned i = 0; i < succ_comps.size(); i++)
+						S |= closed[succ_comps[i]];
+				});
+			}
+		}
+
+		/* pairs (a, b) where b is reachable from a along at least one edge */
+		uint64_t reachable_pairs() const {
+			uint64_t total = 0;
+			for (unsigned c = 0; c < members.size(); c++)
+				total += (uint64_t)members[c].size() * (closed[c].count() - (cyclic[c] ? 0 : 1));
+			return total;
+		}
+	};
+}
+
+static cl::opt<std::string> ReachFrom("reach-from", cl::init(""),
+	cl::desc("reach: only answer whether -reach-to is reachable from this block"));
+static cl::opt<std::string> ReachTo("reach-to", cl::init(""),
+	cl::desc("reach: target block for -reach-from"));
+static cl::opt<std::string> ReachPairs("reach-pairs", cl::init(""),
+	cl::desc("reach: file of 'function source target' lines to answer"));
+
 namespace {
 	struct Reach : public FunctionPass {
 		static char ID;
+		static uint64_t reachable_pairs;
+		static int skipped;
+		static unsigned queries;
+		static double query_ns;
+		/* function name -> (source, target) block names, from -reach-pairs */
+		static std::map<std::string, std::vector<std::pair<std::string, std::string> > > pairs;
 		Reach() : FunctionPass(ID) {}
 
+		bool query_mode() {
+			return !ReachPairs.empty() || (!ReachFrom.empty() && !ReachTo.empty());
+		}
+
+		bool doInitialization(Module &M) override {
+			if (ReachPairs.empty())
+				return false;
+			ErrorOr<std::unique_ptr<MemoryBuffer> > buf = MemoryBuffer::getFile(ReachPairs);
+			if (!buf) {
+				errs() << "reach: cannot read " << ReachPairs << "\n";
+				return false;
+			}
+			std::istringstream lines((*buf)->getBuffer().str());
+			std::string func, from, to;
+			while (lines >> func >> from >> to)
+				pairs[func].push_back(std::make_pair(from, to));
+			return false;
+		}
+
 		bool runOnFunction(Function &F) override {
-			// BasicBlock *A;
-			// BasicBlock *B;
-			// A = &F.getEntryBlock();
-			// B = A->getTerminator()->getSuccessor(0);
+			if (query_mode()) {
+				run_queries(F);
+				return false;
+			}
+			double n = F.size();
+			double e = count_edges(F);
+			std::vector<Variant> variants;
+			double pairwise_ops = n * n * (n + e) * std::log2(n + 1);
+			double scc_ops = (n + e) * (n / 64 + 1) + n * n / 64;
+			variants.push_back({"pairwise", pairwise_ops, 48 * n, 2.5 * pairwise_ops});
+			variants.push_back({"per-source", n * (n + e), 2 * n * sizeof(void *), 5 * n * (n + e)});
+			/* word-wide unions along condensation edges, n bits per SCC */
+			variants.push_back({"scc-levels", scc_ops, n * n / 8, 25 * scc_ops});
+			int v = pick_variant("reach", F, variants);
+			if (v < 0) {
+				skipped++;
+				return false;
+			}
+			if (ClosureBench)
+				bench(F, variants[v], variants[1], variants[2]);
+			if (v == 0) {
+				reachable_pairs += reach_pairwise(F);
+			} else if (v == 1) {
+				ReachIndex index(F);
+				reachable_pairs += reach_per_source(index, closure_threads(F));
+			} else {
+				ReachIndex index(F);
+				SCCClosure closure(index);
+				closure.run(index, closure_threads(F));
+				reachable_pairs += closure.reachable_pairs();
+			}
+			return false;
+		}
 
+		/* seven runs of each parallel engine, on top of the chosen one */
+		void bench(Function &F, const Variant &chosen, const Variant &per_source_cost, const Variant &scc_cost) {
+			double ops = 7 * (per_source_cost.ops + scc_cost.ops);
+			double ns = 7 * (per_source_cost.ns + scc_cost.ns);
+			if (!fits_budget(chosen.ops + ops, chosen.bytes + scc_cost.bytes, chosen.ns + ns)) {
+				errs() << "[budget] reach: no closure-bench for " << F.getName()
+				       << ", it needs another ~" << format("%.3g", ns / 1e9) << " s\n";
+				return;
+			}
+			ReachIndex index(F);
+			SCCClosure closure(index);
+			std::vector<double> per_source, scc;
+			for (unsigned t = 1; t <= 64; t *= 2) {
+				per_source.push_back(time_ns([&] { reach_per_source(index, t); }) / 1e6);
+				scc.push_back(time_ns([&] { closure.run(index, t); }) / 1e6);
+			}
+			print_scaling("reach per-source", F, per_source);
+			print_scaling("reach scc-levels", F, scc);
+			errs() << "  " << closure.members.size() << " SCCs on " << closure.levels.size() << " levels\n";
+		}
 
-			for (Function::iterator bb = F.begin(), bb_end = F.end(); bb != bb_end; bb++) {
-				BasicBlock &b1 = *bb;
-				for (Function::iterator bb_in = F.begin(), bb_in_end = F.end(); bb_in != bb_in_end; bb_in++) {
-					BasicBlock &b2 = *bb_in;
-					if (bfs(&b1, &b2))
-						;// errs() << b1.getName() << " to " << b2.getName() << " is reachable\n";
-					else
-						;// errs() << b1.getName() << " to " << b2.getName() << " is NOT reachable\n";
+		void run_queries(Function &F) {
+			std::vector<std::pair<std::string, std::string> > todo;
+			if (!ReachFrom.empty() && !ReachTo.empty())
+				todo.push_back(std::make_pair(std::string(ReachFrom), std::string(ReachTo)));
+			std::map<std::string, std::vector<std::pair<std::string, std::string> > >::iterator it =
+				pairs.find(F.getName().str());
+			if (it != pairs.end())
+				todo.insert(todo.end(), it->second.begin(), it->second.end());
+			if (todo.empty())
+				return;
+
+			std::map<std::string, unsigned> by_name;
+			unsigned id = 0;
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++, id++)
+				if (bb->hasName())
+					by_name[bb->getName().str()] = id;
+			ReachIndex index(F);
+			for (unsigned i = 0; i < todo.size(); i++) {
+				std::map<std::string, unsigned>::iterator from = by_name.find(todo[i].first);
+				std::map<std::string, unsigned>::iterator to = by_name.find(todo[i].second);
+				if (from == by_name.end() || to == by_name.end()) {
+					/* -reach-from/-reach-to are tried on every function */
+					if (it != pairs.end())
+						errs() << "reach " << F.getName() << ": no block " << todo[i].first
+						       << " or " << todo[i].second << "\n";
+					continue;
 				}
+				std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+				bool reachable = index.query(from->second, to->second);
+				double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+				queries++;
+				query_ns += ns;
+				errs() << "reach " << F.getName() << ": " << todo[i].first << " -> " << todo[i].second
+				       << (reachable ? " is reachable" : " is NOT reachable")
+				       << " (" << format("%.0f", ns) << " ns)\n";
 			}
+		}
 
-			// if (bfs(A, B))
-			// 	std::cout << "A to B is reachable\n";
-			// else
-			// 	std::cout << "A to B is NOT reachable\n";
-			// return false;
+		bool doFinalization(Module &M) override {
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			if (query_mode()) {
+				std::cout << "queries: " << queries << "\n";
+				std::cout << "average latency (ns): " << (queries ? query_ns / queries : 0) << "\n";
+				return false;
+			}
+			std::cout << "reachable block pairs: " << reachable_pairs << "\n";
+			std::cout << "functions skipped (over budget): " << skipped << "\n";
 			return false;
 		}
+	};
+}
+
+char Reach::ID = 0;
+uint64_t Reach::reachable_pairs;
+int Reach::skipped;
+unsigned Reach::queries;
+double Reach::query_ns;
+std::map<std::string, std::vector<std::pair<std::string, std::string> > > Reach::pairs;
+static RegisterPass<Reach> H("reach", "reachability from basic block A to B");
 
-		bool bfs(BasicBlock *A, BasicBlock *B) {
-			std::queue<BasicBlock *> q;
-			std::map<BasicBlock *, bool> visited;
-			q.push(A);
+/* 4: Analysis server. Keeps parsed modules and their analyses resident and
+ * answers batched queries over a Unix domain socket, so tools don't pay for
+ * process startup, plugin load and bitcode parsing on every question.
+ *
+ *   opt -load Part2.so -serve -serve-socket=/tmp/p2.sock -disable-output seed.ll
+ *
+ * Every message, both ways, is a little-endian u32 payload length followed by
+ * the payload. Strings are a u16 length and the bytes (names in replies are
+ * cut at 65535 bytes); blocks are addressed by their layout index inside the
+ * function (see 'B'). A request longer than -serve-max-frame-mb gets a bare
+ * SERVE_BAD_REQUEST and the connection is closed. Connections are served
+ * together from one poll() loop, so an idle client or a half-sent frame
+ * doesn't hold up anyone else; a client that stops reading its replies is
+ * dropped after -serve-send-timeout seconds. Requests:
+ *
+ *   'L' path                      -> status, u32 module id
+ *   'B' u32 module, func          -> status, u32 n, n x block name
+ *   'Q' u32 module, u32 n, n x (u8 kind, func, u32 a, u32 b)
+ *                                 -> status, n x (status, u32 m, m x u32)
+ *   'U' u32 module                -> status
+ *   'S'                           -> status, then the server exits
+ *
+ * Query kinds: 1 = is b reachable from a (along at least one edge), 2 = does a
+ * dominate b, 3 = blocks that a is control dependent on, 4 = loop depth of a
+ * and its loop header's index + 1 (0 when not in a loop). The module opt was
+ * run on is module 0 and is never evicted. Other modules are evicted least
+ * recently used first once the estimated cache size exceeds -serve-cache-mb. */
+static cl::opt<std::string> ServeSocket("serve-socket", cl::init("/tmp/llvm-pass-basics.sock"),
+	cl::desc("Unix socket path for the analysis server"));
+static cl::opt<unsigned> ServeCacheMB("serve-cache-mb", cl::init(1024),
+	cl::desc("Estimated memory the analysis server may keep cached, in MB"));
+static cl::opt<unsigned> ServeMaxFrameMB("serve-max-frame-mb", cl::init(64),
+	cl::desc("Largest request the analysis server accepts, in MB"));
+static cl::opt<unsigned> ServeSendTimeout("serve-send-timeout", cl::init(5),
+	cl::desc("Seconds the analysis server waits on a client that doesn't read its replies"));
 
-			while (q.size() > 0) {
-				BasicBlock *blk = q.front();
-				q.pop();
-				visited[blk] = true;
-				const TerminatorInst *TInst = blk->getTerminator();
+namespace {
+	enum ServeStatus { SERVE_OK = 0, SERVE_BAD_REQUEST, SERVE_NO_MODULE, SERVE_NO_FUNCTION,
+			   SERVE_NO_BLOCK, SERVE_LOAD_FAILED };
+
+	/* analyses of one function, built the first time it is queried */
+	struct FunctionCache {
+		std::vector<BasicBlock *> blocks;
+		DenseMap<const BasicBlock *, unsigned> ids;
+		DominatorTree DT;
+		DominatorTreeBase<BasicBlock> PDT;
+		LoopInfo LI;
+		std::vector<BitVector> reach;	/* reach[a], filled per source on demand */
+		std::vector<bool> has_reach;
+		std::vector<std::vector<unsigned> > controllers; /* empty until first cdep query */
+		size_t bytes;
+
+		FunctionCache(Function &F) : PDT(true), bytes(0) {
+			number_blocks(F, ids);
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+				blocks.push_back(&*bb);
+			DT.recalculate(F);
+			PDT.recalculate(F);
+			LI.analyze(DT);
+			reach.resize(blocks.size());
+			has_reach.resize(blocks.size(), false);
+			/* trees, loop info and id maps, roughly */
+			bytes = blocks.size() * 256;
+		}
+
+		const BitVector &reachable_from(unsigned a) {
+			if (has_reach[a])
+				return reach[a];
+			BitVector &seen = reach[a];
+			seen.resize(blocks.size());
+			std::vector<unsigned> queue(1, a);
+			for (unsigned head = 0; head < queue.size(); head++) {
+				const TerminatorInst *TInst = blocks[queue[head]]->getTerminator();
 				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
-					BasicBlock *succ = TInst->getSuccessor(i);
-					if (succ == B)
+					unsigned id = ids[TInst->getSuccessor(i)];
+					if (seen.test(id))
+						continue;
+					seen.set(id);
+					queue.push_back(id);
+				}
+			}
+			has_reach[a] = true;
+			bytes += blocks.size() / 8 + sizeof(BitVector);
+			return seen;
+		}
+
+		const std::vector<unsigned> &controllers_of(Function &F, unsigned x) {
+			if (controllers.empty()) {
+				std::vector<std::vector<BasicBlock *> > deps;
+				unsigned covered = 0;
+				for (df_iterator<DomTreeNode *> node = df_begin(PDT.getRootNode()),
+					     node_end = df_end(PDT.getRootNode()); node != node_end; ++node)
+					if (node->getBlock())
+						covered++;
+				if (covered == blocks.size())
+					cdep_walk(F, PDT, deps);
+				else
+					cdep_pairwise(F, PDT, deps);
+				controllers.resize(blocks.size());
+				for (unsigned b1 = 0; b1 < deps.size(); b1++)
+					for (unsigned i = 0; i < deps[b1].size(); i++)
+						controllers[ids[deps[b1][i]]].push_back(b1);
+				bytes += blocks.size() * sizeof(std::vector<unsigned>);
+				for (unsigned b1 = 0; b1 < deps.size(); b1++)
+					bytes += deps[b1].size() * sizeof(unsigned);
+			}
+			return controllers[x];
+		}
+	};
+
+	struct CachedModule {
+		std::unique_ptr<Module> owned;	/* NULL for the module opt was run on */
+		Module *M;
+		std::map<std::string, std::unique_ptr<FunctionCache> > funcs;
+		size_t ir_bytes;
+	};
+
+	/* cursor over a request payload; any short read marks it bad */
+	struct Reader {
+		const std::string &buf;
+		size_t pos;
+		bool bad;
+		Reader(const std::string &buf) : buf(buf), pos(0), bad(false) {}
+
+		uint32_t get(unsigned width) {
+			if (pos + width > buf.size()) {
+				bad = true;
+				return 0;
+			}
+			uint32_t v = 0;
+			for (unsigned i = 0; i < width; i++)
+				v |= (uint32_t)(unsigned char)buf[pos + i] << (8 * i);
+			pos += width;
+			return v;
+		}
+		uint8_t get8() { return get(1); }
+		uint32_t get32() { return get(4); }
+		std::string get_str() {
+			uint32_t len = get(2);
+			if (bad || pos + len > buf.size()) {
+				bad = true;
+				return std::string();
+			}
+			pos += len;
+			return buf.substr(pos - len, len);
+		}
+	};
+
+	struct Writer {
+		std::string buf;
+		void put(uint32_t v, unsigned width) {
+			for (unsigned i = 0; i < width; i++)
+				buf.push_back((char)(v >> (8 * i)));
+		}
+		void put8(uint8_t v) { put(v, 1); }
+		void put32(uint32_t v) { put(v, 4); }
+		/* the length is a u16, so longer strings are cut to keep the framing */
+		void put_str(StringRef s) {
+			size_t len = std::min<size_t>(s.size(), 0xffff);
+			put(len, 2);
+			buf.append(s.data(), len);
+		}
+	};
+
+	struct AnalysisServer : public ModulePass {
+		static char ID;
+		LLVMContext context;	/* owns every module loaded through the socket */
+		std::map<uint32_t, CachedModule> modules;
+		std::list<uint32_t> lru;	/* most recently used first */
+		uint32_t next_id;
+		bool done;
+		AnalysisServer() : ModulePass(ID), next_id(1), done(false) {}
+
+		bool runOnModule(Module &M) override {
+			CachedModule &seed = modules[0];
+			seed.M = &M;
+			seed.ir_bytes = 0;
+			lru.push_front(0);
+
+			int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+			struct sockaddr_un addr;
+			memset(&addr, 0, sizeof(addr));
+			addr.sun_family = AF_UNIX;
+			strncpy(addr.sun_path, ServeSocket.c_str(), sizeof(addr.sun_path) - 1);
+			unlink(addr.sun_path);
+			if (sock < 0 || bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(sock, 16) < 0) {
+				errs() << "serve: cannot listen on " << ServeSocket << ": " << strerror(errno) << "\n";
+				if (sock >= 0)
+					close(sock);
+				return false;
+			}
+			errs() << "serve: listening on " << ServeSocket << "\n";
+
+			/* fds[0] is the listening socket; pending[c] holds the bytes
+			 * of connection c's next frames that have arrived so far */
+			std::vector<struct pollfd> fds(1);
+			std::vector<std::string> pending(1);
+			fds[0].fd = sock;
+			fds[0].events = POLLIN;
+			while (!done) {
+				if (poll(&fds[0], fds.size(), -1) < 0) {
+					if (errno == EINTR)
+						continue;
+					errs() << "serve: poll failed: " << strerror(errno) << "\n";
+					break;
+				}
+				if (fds[0].revents & POLLIN) {
+					int conn = accept(sock, NULL, NULL);
+					if (conn >= 0) {
+						struct timeval timeout;
+						timeout.tv_sec = ServeSendTimeout;
+						timeout.tv_usec = 0;
+						setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+						struct pollfd pfd;
+						pfd.fd = conn;
+						pfd.events = POLLIN;
+						pfd.revents = 0;
+						fds.push_back(pfd);
+						pending.push_back(std::string());
+					}
+				}
+				for (unsigned c = fds.size() - 1; c >= 1 && !done; c--) {
+					if (!fds[c].revents || serve_ready(fds[c].fd, pending[c]))
+						continue;
+					close(fds[c].fd);
+					fds.erase(fds.begin() + c);
+					pending.erase(pending.begin() + c);
+				}
+			}
+			for (unsigned c = 1; c < fds.size(); c++)
+				close(fds[c].fd);
+			close(sock);
+			unlink(addr.sun_path);
+			modules.clear();
+			return false;
+		}
+
+		void handle(const std::string &request, Writer &reply) {
+			Reader in(request);
+			uint8_t op = in.get8();
+			switch (op) {
+			case 'L': {
+				std::string path = in.get_str();
+				if (in.bad) {
+					reply.put8(SERVE_BAD_REQUEST);
+					return;
+				}
+				SMDiagnostic err;
+				std::unique_ptr<Module> loaded = parseIRFile(path, err, context);
+				if (!loaded) {
+					errs() << "serve: cannot load " << path << ": " << err.getMessage() << "\n";
+					reply.put8(SERVE_LOAD_FAILED);
+					return;
+				}
+				uint32_t id = next_id++;
+				CachedModule &cm = modules[id];
+				cm.M = loaded.get();
+				cm.owned = std::move(loaded);
+				cm.ir_bytes = 0;
+				for (Module::iterator f = cm.M->begin(); f != cm.M->end(); f++)
+					for (Function::iterator bb = f->begin(); bb != f->end(); bb++)
+						cm.ir_bytes += 64 * (bb->size() + 1);
+				lru.push_front(id);
+				evict(id);
+				reply.put8(SERVE_OK);
+				reply.put32(id);
+				return;
+			}
+			case 'B': {
+				CachedModule *cm = lookup(in.get32());
+				std::string name = in.get_str();
+				if (in.bad || !cm) {
+					reply.put8(in.bad ? SERVE_BAD_REQUEST : SERVE_NO_MODULE);
+					return;
+				}
+				Function *F = cm->M->getFunction(name);
+				if (!F || F->isDeclaration()) {
+					reply.put8(SERVE_NO_FUNCTION);
+					return;
+				}
+				reply.put8(SERVE_OK);
+				reply.put32(F->size());
+				for (Function::iterator bb = F->begin(); bb != F->end(); bb++)
+					reply.put_str(bb->getName());
+				return;
+			}
+			case 'Q': {
+				uint32_t id = in.get32();
+				CachedModule *cm = lookup(id);
+				uint32_t count = in.get32();
+				if (in.bad || !cm) {
+					reply.put8(in.bad ? SERVE_BAD_REQUEST : SERVE_NO_MODULE);
+					return;
+				}
+				reply.put8(SERVE_OK);
+				for (uint32_t q = 0; q < count && !in.bad; q++) {
+					uint8_t kind = in.get8();
+					std::string name = in.get_str();
+					uint32_t a = in.get32();
+					uint32_t b = in.get32();
+					if (in.bad) {
+						reply.put8(SERVE_BAD_REQUEST);
+						reply.put32(0);
+						break;
+					}
+					query(*cm, kind, name, a, b, reply);
+				}
+				evict(id);
+				return;
+			}
+			case 'U': {
+				uint32_t id = in.get32();
+				if (in.bad || id == 0 || !modules.count(id)) {
+					reply.put8(in.bad ? SERVE_BAD_REQUEST : SERVE_NO_MODULE);
+					return;
+				}
+				modules.erase(id);
+				lru.remove(id);
+				reply.put8(SERVE_OK);
+				return;
+			}
+			case 'S':
+				done = true;
+				reply.put8(SERVE_OK);
+				return;
+			default:
+				reply.put8(SERVE_BAD_REQUEST);
+			}
+		}
+
+		void query(CachedModule &cm, uint8_t kind, const std::string &name, uint32_t a, uint32_t b, Writer &reply) {
+			Function *F = cm.M->getFunction(name);
+			if (!F || F->isDeclaration()) {
+				reply.put8(SERVE_NO_FUNCTION);
+				reply.put32(0);
+				return;
+			}
+			std::unique_ptr<FunctionCache> &fc = cm.funcs[name];
+			if (!fc)
+				fc.reset(new FunctionCache(*F));
+			unsigned n = fc->blocks.size();
+			if (a >= n || ((kind == 1 || kind == 2) && b >= n)) {
+				reply.put8(SERVE_NO_BLOCK);
+				reply.put32(0);
+				return;
+			}
+			switch (kind) {
+			case 1:
+				reply.put8(SERVE_OK);
+				reply.put32(1);
+				reply.put32(fc->reachable_from(a).test(b));
+				return;
+			case 2:
+				reply.put8(SERVE_OK);
+				reply.put32(1);
+				reply.put32(fc->DT.dominates(fc->blocks[a], fc->blocks[b]));
+				return;
+			case 3: {
+				const std::vector<unsigned> &ctl = fc->controllers_of(*F, a);
+				reply.put8(SERVE_OK);
+				reply.put32(ctl.size());
+				for (unsigned i = 0; i < ctl.size(); i++)
+					reply.put32(ctl[i]);
+				return;
+			}
+			case 4: {
+				Loop *L = fc->LI.getLoopFor(fc->blocks[a]);
+				reply.put8(SERVE_OK);
+				reply.put32(2);
+				reply.put32(L ? L->getLoopDepth() : 0);
+				reply.put32(L ? fc->ids[L->getHeader()] + 1 : 0);
+				return;
+			}
+			default:
+				reply.put8(SERVE_BAD_REQUEST);
+				reply.put32(0);
+			}
+		}
+
+		CachedModule *lookup(uint32_t id) {
+			std::map<uint32_t, CachedModule>::iterator it = modules.find(id);
+			if (it == modules.end())
+				return NULL;
+			lru.remove(id);
+			lru.push_front(id);
+			return &it->second;
+		}
+
+		size_t cached_bytes() {
+			size_t total = 0;
+			for (std::map<uint32_t, CachedModule>::iterator m = modules.begin(); m != modules.end(); m++) {
+				total += m->second.ir_bytes;
+				for (std::map<std::string, std::unique_ptr<FunctionCache> >::iterator f = m->second.funcs.begin();
+				     f != m->second.funcs.end(); f++)
+					total += f->second->bytes;
+			}
+			return total;
+		}
+
+		/* drops least recently used modules, except module 0 and the one in use */
+		void evict(uint32_t in_use) {
+			size_t budget = (size_t)ServeCacheMB * 1024 * 1024;
+			std::list<uint32_t>::iterator it = lru.end();
+			while (cached_bytes() > budget && it != lru.begin()) {
+				--it;
+				if (*it == 0 || *it == in_use)
+					continue;
+				errs() << "serve: evicting module " << *it << "\n";
+				modules.erase(*it);
+				it = lru.erase(it);
+			}
+		}
+
+		/* Reads what poll() said is waiting on fd and answers every frame
+		 * completed by it. Returns false when the connection should be
+		 * closed: EOF, errors, oversized frames, failed replies. The
+		 * length comes off the wire, so it is checked before buffering. */
+		bool serve_ready(int fd, std::string &pending) {
+			char chunk[65536];
+			ssize_t got = recv(fd, chunk, sizeof(chunk), 0);
+			if (got < 0 && errno == EINTR)
+				return true;
+			if (got <= 0)
+				return false;
+			pending.append(chunk, got);
+			while (!done && pending.size() >= 4) {
+				const unsigned char *hdr = (const unsigned char *)pending.data();
+				uint32_t len = hdr[0] | hdr[1] << 8 | hdr[2] << 16 | (uint32_t)hdr[3] << 24;
+				if (len > (uint64_t)ServeMaxFrameMB * 1024 * 1024) {
+					Writer reply;
+					reply.put8(SERVE_BAD_REQUEST);
+					write_frame(fd, reply.buf);
+					return false;
+				}
+				if (pending.size() - 4 < len)
+					break;
+				std::string request = pending.substr(4, len);
+				pending.erase(0, 4 + (size_t)len);
+				Writer reply;
+				handle(request, reply);
+				if (!write_frame(fd, reply.buf))
+					return false;
+			}
+			return true;
+		}
+
+		static bool write_frame(int fd, const std::string &payload) {
+			Writer frame;
+			frame.put32(payload.size());
+			frame.buf += payload;
+			const char *buf = frame.buf.data();
+			size_t len = frame.buf.size();
+			while (len > 0) {
+				/* a client that hung up gives EPIPE here instead of
+				 * SIGPIPE killing the server; drop the connection */
+				ssize_t put = send(fd, buf, len, MSG_NOSIGNAL);
+				if (put < 0 && errno == EINTR)
+					continue;
+				if (put <= 0)
+					return false;
+				buf += put;
+				len -= put;
+			}
+			return true;
+		}
+	};
+}
+
+char AnalysisServer::ID = 0;
+static RegisterPass<AnalysisServer> K("serve", "analysis server over a Unix domain socket");
+
+/* 5: CFG diff between two builds of a module.
+ *
+ *   opt -load Part2.so -cfgdiff -diff-against=old.bc -disable-output new.bc
+ *
+ * Functions are matched by name, then leftovers by CFG shape hash. Functions
+ * whose shape hash is unchanged are skipped without building any analysis,
+ * since every metric below depends only on the shape. The rest get the
+ * bbcount/cfg/sel/allloops/dc metrics on both sides, and only the ones that
+ * changed are reported, as old -> new (+delta). */
+static cl::opt<std::string> DiffAgainst("diff-against", cl::init(""),
+	cl::desc("cfgdiff: IR or bitcode file of the old build to compare against"));
+
+/* hashes block count and every block's successor ids in layout order */
+static hash_code cfg_hash(Function &F) {
+	DenseMap<const BasicBlock *, unsigned> ids;
+	number_blocks(F, ids);
+	hash_code h = hash_value(F.size());
+	for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+		const TerminatorInst *TInst = bb->getTerminator();
+		h = hash_combine(h, TInst->getNumSuccessors());
+		for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++)
+			h = hash_combine(h, ids[TInst->getSuccessor(i)]);
+	}
+	return h;
+}
+
+namespace {
+	enum { M_BLOCKS, M_EDGES, M_BACKEDGES, M_LOOPS, M_DOMS, M_DOM_DEPTH, M_COUNT };
+	const char *const metric_names[M_COUNT] = {
+		"blocks", "edges", "back edges", "loops", "dom count", "max dom depth"
+	};
+
+	struct CFGMetrics {
+		int values[M_COUNT];
+
+		CFGMetrics(Function &F) {
+			DominatorTree DT;
+			DT.recalculate(F);
+			LoopInfo LI;
+			LI.analyze(DT);
+			int depth = 0;
+			for (df_iterator<DomTreeNode *> node = df_begin(DT.getRootNode()),
+				     node_end = df_end(DT.getRootNode()); node != node_end; ++node)
+				depth = std::max(depth, (int)node.getPathLength() - 1);
+			values[M_BLOCKS] = F.size();
+			values[M_EDGES] = count_edges(F);
+			values[M_BACKEDGES] = count_backedges(F, DT);
+			values[M_LOOPS] = count_all_loops(LI);
+			values[M_DOMS] = dom_count_depth(F, DT);
+			values[M_DOM_DEPTH] = depth;
+		}
+	};
+
+	struct CFGDiff : public ModulePass {
+		static char ID;
+		CFGDiff() : ModulePass(ID) {}
+
+		bool runOnModule(Module &M) override {
+			if (DiffAgainst.empty()) {
+				errs() << "cfgdiff: no -diff-against module given\n";
+				return false;
+			}
+			LLVMContext context;
+			SMDiagnostic err;
+			std::unique_ptr<Module> old_module = parseIRFile(DiffAgainst, err, context);
+			if (!old_module) {
+				errs() << "cfgdiff: cannot load " << DiffAgainst << ": " << err.getMessage() << "\n";
+				return false;
+			}
+
+			int by_name = 0, by_hash = 0, identical = 0, changed = 0;
+			std::set<Function *> matched_old;
+			std::vector<Function *> unmatched_new;
+			for (Module::iterator f = M.begin(); f != M.end(); f++) {
+				if (f->isDeclaration())
+					continue;
+				Function *old_f = old_module->getFunction(f->getName());
+				if (!old_f || old_f->isDeclaration()) {
+					unmatched_new.push_back(&*f);
+					continue;
+				}
+				matched_old.insert(old_f);
+				by_name++;
+				if (compare(*old_f, *f))
+					changed++;
+				else
+					identical++;
+			}
+
+			/* renamed functions: pair leftovers with the same shape */
+			std::multimap<size_t, Function *> old_by_hash;
+			for (Module::iterator f = old_module->begin(); f != old_module->end(); f++)
+				if (!f->isDeclaration() && !matched_old.count(&*f))
+					old_by_hash.insert(std::make_pair((size_t)cfg_hash(*f), &*f));
+			int only_new = 0;
+			for (unsigned i = 0; i < unmatched_new.size(); i++) {
+				std::multimap<size_t, Function *>::iterator it = old_by_hash.find(cfg_hash(*unmatched_new[i]));
+				if (it == old_by_hash.end()) {
+					std::cout << unmatched_new[i]->getName().str() << ": only in new build\n";
+					only_new++;
+					continue;
+				}
+				std::cout << unmatched_new[i]->getName().str() << ": same shape as "
+					  << it->second->getName().str() << " in old build\n";
+				old_by_hash.erase(it);
+				by_hash++;
+			}
+			for (std::multimap<size_t, Function *>::iterator it = old_by_hash.begin(); it != old_by_hash.end(); it++)
+				std::cout << it->second->getName().str() << ": only in old build\n";
+
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			std::cout << "matched by name: " << by_name << "\n";
+			std::cout << "matched by shape hash: " << by_hash << "\n";
+			std::cout << "unchanged: " << identical << "\n";
+			std::cout << "changed: " << changed << "\n";
+			std::cout << "only in new build: " << only_new << "\n";
+			std::cout << "only in old build: " << old_by_hash.size() << "\n";
+			return false;
+		}
+
+		/* prints the metrics that changed; false if none did */
+		bool compare(Function &old_f, Function &new_f) {
+			if (cfg_hash(old_f) == cfg_hash(new_f))
+				return false;
+			CFGMetrics before(old_f);
+			CFGMetrics after(new_f);
+			std::ostringstream line;
+			for (unsigned i = 0; i < M_COUNT; i++) {
+				int delta = after.values[i] - before.values[i];
+				if (delta == 0)
+					continue;
+				line << " " << metric_names[i] << " " << before.values[i] << " -> "
+				     << after.values[i] << " (" << (delta > 0 ? "+" : "") << delta << ")";
+			}
+			if (line.str().empty())
+				return false;
+			std::cout << new_f.getName().str() << ":" << line.str() << "\n";
+			return true;
+		}
+	};
+}
+
+char CFGDiff::ID = 0;
+static RegisterPass<CFGDiff> L("cfgdiff", "CFG metric deltas against another build of the module");
+
+/* 6: Differential oracle harness. Generates random and adversarial CFGs,
+ * runs the reference implementations above as oracles next to their faster
+ * variants, and compares the results exactly. A failing CFG is shrunk by
+ * deleting edges and blocks while the mismatch persists, then printed.
+ *
+ *   opt -load Part2.so -oracle -oracle-iters=100000 -disable-output any.ll
+ *
+ * To cover a new variant, add a check_* function to oracle_checks. */
+static cl::opt<unsigned> OracleIters("oracle-iters", cl::init(1000),
+	cl::desc("oracle: number of CFGs to generate"));
+static cl::opt<unsigned> OracleMaxBlocks("oracle-max-blocks", cl::init(48),
+	cl::desc("oracle: largest generated CFG, in blocks"));
+static cl::opt<unsigned> OracleSeed("oracle-seed", cl::init(1),
+	cl::desc("oracle: random seed"));
+
+namespace {
+	/* A CFG to build: block 0 is the entry and is never a successor. Blocks
+	 * without successors end in ret, or unreachable when marked. */
+	struct CFGSpec {
+		std::vector<std::vector<unsigned> > succs;
+		std::vector<bool> unreachable;
+		const char *kind;
+
+		unsigned size() const { return succs.size(); }
+
+		void add_block() {
+			succs.push_back(std::vector<unsigned>());
+			unreachable.push_back(false);
+		}
+
+		/* drops block b and every edge into it; block 0 stays */
+		void remove_block(unsigned b) {
+			succs.erase(succs.begin() + b);
+			unreachable.erase(unreachable.begin() + b);
+			for (unsigned i = 0; i < succs.size(); i++) {
+				std::vector<unsigned> kept;
+				for (unsigned j = 0; j < succs[i].size(); j++)
+					if (succs[i][j] != b)
+						kept.push_back(succs[i][j] > b ? succs[i][j] - 1 : succs[i][j]);
+				succs[i] = kept;
+			}
+		}
+
+		void print(raw_ostream &os) const {
+			for (unsigned i = 0; i < succs.size(); i++) {
+				os << "  b" << i << " ->";
+				for (unsigned j = 0; j < succs[i].size(); j++)
+					os << " b" << succs[i][j];
+				if (succs[i].empty())
+					os << (unreachable[i] ? " (unreachable)" : " (ret)");
+				os << "\n";
+			}
+		}
+	};
+
+	/* void f(i1 %c, i32 %x): conditional branches test %c, switches %x */
+	Function *build_cfg(Module &M, const CFGSpec &spec) {
+		LLVMContext &ctx = M.getContext();
+		Type *args[] = { Type::getInt1Ty(ctx), Type::getInt32Ty(ctx) };
+		FunctionType *FT = FunctionType::get(Type::getVoidTy(ctx), args, false);
+		Function *F = Function::Create(FT, GlobalValue::ExternalLinkage, "oracle", &M);
+		Function::arg_iterator arg = F->arg_begin();
+		Value *cond = &*arg++;
+		Value *sel = &*arg;
+		std::vector<BasicBlock *> blocks;
+		for (unsigned i = 0; i < spec.size(); i++)
+			blocks.push_back(BasicBlock::Create(ctx, "b" + std::to_string(i), F));
+		IRBuilder<> builder(ctx);
+		for (unsigned i = 0; i < spec.size(); i++) {
+			builder.SetInsertPoint(blocks[i]);
+			const std::vector<unsigned> &succ = spec.succs[i];
+			if (succ.empty() && spec.unreachable[i])
+				builder.CreateUnreachable();
+			else if (succ.empty())
+				builder.CreateRetVoid();
+			else if (succ.size() == 1)
+				builder.CreateBr(blocks[succ[0]]);
+			else if (succ.size() == 2)
+				builder.CreateCondBr(cond, blocks[succ[0]], blocks[succ[1]]);
+			else {
+				SwitchInst *SI = builder.CreateSwitch(sel, blocks[succ[0]], succ.size() - 1);
+				for (unsigned j = 1; j < succ.size(); j++)
+					SI->addCase(builder.getInt32(j), blocks[succ[j]]);
+			}
+		}
+		return F;
+	}
+
+	struct CFGGenerator {
+		std::mt19937 rng;
+		CFGGenerator(unsigned seed) : rng(seed) {}
+
+		unsigned pick(unsigned n) {
+			return std::uniform_int_distribution<unsigned>(0, n - 1)(rng);
+		}
+
+		/* a random non-entry block, or 0 when there is none */
+		unsigned target(unsigned n) {
+			return n > 1 ? 1 + pick(n - 1) : 0;
+		}
+
+		CFGSpec generate(unsigned iter) {
+			CFGSpec spec;
+			unsigned n = 1 + pick(OracleMaxBlocks);
+			for (unsigned i = 0; i < n; i++)
+				spec.add_block();
+			static const char *const kinds[] = {
+				"random", "irreducible", "unreachable", "self-loop", "huge switch"
+			};
+			unsigned kind = iter % 5;
+			spec.kind = kinds[kind];
+
+			for (unsigned i = 0; i < n && n > 1; i++) {
+				unsigned nsucc = pick(4);
+				for (unsigned j = 0; j < nsucc; j++)
+					spec.succs[i].push_back(target(n));
+				spec.unreachable[i] = pick(4) == 0;
+			}
+			switch (kind) {
+			case 1: /* loops entered at two different blocks */
+				for (unsigned k = 0; n >= 3 && k < 1 + n / 8; k++) {
+					unsigned a = target(n), b = target(n);
+					spec.succs[0].push_back(a);
+					spec.succs[0].push_back(b);
+					spec.succs[a].push_back(b);
+					spec.succs[b].push_back(a);
+				}
+				break;
+			case 2: /* blocks nothing branches to */
+				for (unsigned i = 0; i < n; i++)
+					for (unsigned j = 0; j < spec.succs[i].size(); j++)
+						if (spec.succs[i][j] > n / 2)
+							spec.succs[i][j] = spec.succs[i][j] % (n / 2 + 1);
+				for (unsigned i = 0; i < n; i++)
+					for (unsigned j = 0; j < spec.succs[i].size(); j++)
+						if (spec.succs[i][j] == 0)
+							spec.succs[i][j] = n > 1 ? 1 : 0;
+				break;
+			case 3:
+				for (unsigned i = 1; i < n; i++)
+					if (pick(2) == 0)
+						spec.succs[i].push_back(i);
+				break;
+			case 4: {
+				unsigned b = pick(n);
+				unsigned cases = 16 + pick(240);
+				for (unsigned j = 0; n > 1 && j < cases; j++)
+					spec.succs[b].push_back(target(n));
+				break;
+			}
+			}
+			/* the entry can't be a successor */
+			for (unsigned i = 0; i < n; i++)
+				for (unsigned j = 0; j < spec.succs[i].size(); j++)
+					if (spec.succs[i][j] == 0)
+						spec.succs[i].erase(spec.succs[i].begin() + j--);
+			return spec;
+		}
+	};
+
+	struct OracleStats {
+		unsigned functions;
+		unsigned blocks;
+		unsigned failures;
+		unsigned skipped;	/* CFGs the check does not apply to; not in the throughput */
+		double ref_ns;
+		double fast_ns;
+		OracleStats() : functions(0), blocks(0), failures(0), skipped(0), ref_ns(0), fast_ns(0) {}
+	};
+
+	/* each check returns false when the variant disagrees with the reference */
+	bool check_dc(Function &F, OracleStats &st) {
+		DominatorTree DT;
+		DT.recalculate(F);
+		int ref = 0, fast = 0;
+		st.ref_ns += time_ns([&] { ref = dom_count_pairwise(F, DT); });
+		st.fast_ns += time_ns([&] { fast = dom_count_depth(F, DT); });
+		return ref == fast;
+	}
+
+	/* the parallel engines run on 4 threads whatever the CFG size */
+	bool check_reach_count(Function &F, OracleStats &st) {
+		uint64_t ref = 0, fast = 0;
+		st.ref_ns += time_ns([&] { ref = reach_pairwise(F); });
+		st.fast_ns += time_ns([&] {
+			ReachIndex index(F);
+			fast = reach_per_source(index, 4);
+		});
+		return ref == fast;
+	}
+
+	bool check_reach_scc(Function &F, OracleStats &st) {
+		uint64_t ref = 0, fast = 0;
+		st.ref_ns += time_ns([&] { ref = reach_pairwise(F); });
+		st.fast_ns += time_ns([&] {
+			ReachIndex index(F);
+			SCCClosure closure(index);
+			closure.run(index, 4);
+			fast = closure.reachable_pairs();
+		});
+		return ref == fast;
+	}
+
+	bool check_warshall(Function &F, OracleStats &st) {
+		DistTable ref_dist, fast_dist;
+		NextTable ref_next, fast_next;
+		warshall_init(F, Warshall::INF, ref_dist, ref_next);
+		warshall_init(F, Warshall::INF, fast_dist, fast_next);
+		st.ref_ns += time_ns([&] { warshall_relax(F, ref_dist, ref_next); });
+		st.fast_ns += time_ns([&] { warshall_relax_dense(F, 4, fast_dist, fast_next); });
+		return ref_dist == fast_dist && ref_next == fast_next;
+	}
+
+	bool check_reach_query(Function &F, OracleStats &st) {
+		std::vector<BasicBlock *> blocks;
+		for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+			blocks.push_back(&*bb);
+		unsigned n = blocks.size();
+		std::vector<char> ref(n * n), fast(n * n);
+		st.ref_ns += time_ns([&] {
+			for (unsigned a = 0; a < n; a++)
+				for (unsigned b = 0; b < n; b++)
+					ref[a * n + b] = reach_bfs(blocks[a], blocks[b]);
+		});
+		st.fast_ns += time_ns([&] {
+			ReachIndex index(F);
+			for (unsigned a = 0; a < n; a++)
+				for (unsigned b = 0; b < n; b++)
+					fast[a * n + b] = index.query(a, b);
+		});
+		return ref == fast;
+	}
+
+	bool check_cdep(Function &F, OracleStats &st) {
+		DominatorTreeBase<BasicBlock> PDT(true);
+		PDT.recalculate(F);
+		unsigned covered = 0;
+		for (df_iterator<DomTreeNode *> node = df_begin(PDT.getRootNode()),
+			     node_end = df_end(PDT.getRootNode()); node != node_end; ++node)
+			if (node->getBlock())
+				covered++;
+		/* cdep only uses the walk when every block is in the tree */
+		if (covered != F.size()) {
+			st.skipped++;
+			return true;
+		}
+		std::vector<std::vector<BasicBlock *> > ref, fast;
+		st.ref_ns += time_ns([&] { cdep_pairwise(F, PDT, ref); });
+		st.fast_ns += time_ns([&] { cdep_walk(F, PDT, fast); });
+		return ref == fast;
+	}
+
+	struct OracleCheck {
+		const char *name;
+		bool (*run)(Function &F, OracleStats &st);
+	};
+
+	const OracleCheck oracle_checks[] = {
+		{ "dc: pairwise vs tree-depth", check_dc },
+		{ "reach: pairwise vs per-source", check_reach_count },
+		{ "reach: pairwise vs scc-levels", check_reach_scc },
+		{ "reach: reach_bfs vs ReachIndex", check_reach_query },
+		{ "cdep: pairwise vs pdt-walk", check_cdep },
+		{ "warshall: map vs dense relax", check_warshall },
+	};
+	const unsigned num_oracle_checks = sizeof(oracle_checks) / sizeof(oracle_checks[0]);
+
+	struct Oracle : public ModulePass {
+		static char ID;
+		Oracle() : ModulePass(ID) {}
+
+		/* true if check still fails on spec; builds into a scratch module */
+		bool fails(const OracleCheck &check, const CFGSpec &spec) {
+			LLVMContext ctx;
+			Module M("oracle", ctx);
+			OracleStats scratch;
+			return !check.run(*build_cfg(M, spec), scratch);
+		}
+
+		/* greedy delta debugging: drop edges, then blocks, until nothing
+		 * more can go without the mismatch disappearing */
+		CFGSpec shrink(const OracleCheck &check, CFGSpec spec) {
+			bool progress = true;
+			while (progress) {
+				progress = false;
+				for (unsigned i = 0; i < spec.size(); i++)
+					for (unsigned j = 0; j < spec.succs[i].size(); j++) {
+						CFGSpec smaller = spec;
+						smaller.succs[i].erase(smaller.succs[i].begin() + j);
+						if (fails(check, smaller)) {
+							spec = smaller;
+							progress = true;
+							j--;
+						}
+					}
+				for (unsigned b = spec.size() - 1; b >= 1; b--) {
+					CFGSpec smaller = spec;
+					smaller.remove_block(b);
+					if (fails(check, smaller)) {
+						spec = smaller;
+						progress = true;
+					}
+				}
+			}
+			return spec;
+		}
+
+		bool runOnModule(Module &) override {
+			CFGGenerator gen(OracleSeed);
+			std::vector<OracleStats> stats(num_oracle_checks);
+			for (unsigned iter = 0; iter < OracleIters; iter++) {
+				CFGSpec spec = gen.generate(iter);
+				LLVMContext ctx;
+				Module M("oracle", ctx);
+				Function *F = build_cfg(M, spec);
+				for (unsigned c = 0; c < num_oracle_checks; c++) {
+					OracleStats &st = stats[c];
+					unsigned skipped = st.skipped;
+					bool agree = oracle_checks[c].run(*F, st);
+					if (st.skipped == skipped) {
+						st.functions++;
+						st.blocks += spec.size();
+					}
+					if (agree)
+						continue;
+					st.failures++;
+					CFGSpec small = shrink(oracle_checks[c], spec);
+					errs() << "oracle: " << oracle_checks[c].name << " mismatch on " << spec.kind
+					       << " CFG #" << iter << ", shrunk from " << spec.size() << " to "
+					       << small.size() << " blocks:\n";
+					small.print(errs());
+					LLVMContext repro_ctx;
+					Module repro("oracle", repro_ctx);
+					build_cfg(repro, small)->print(errs());
+				}
+			}
+
+			std::cout << "------------------------------\n";
+			std::cout << "Summary (" << OracleIters << " CFGs, seed " << OracleSeed << "):\n";
+			for (unsigned c = 0; c < num_oracle_checks; c++) {
+				const OracleStats &st = stats[c];
+				std::cout << oracle_checks[c].name << ": " << st.failures << " mismatches, "
+					  << "reference " << (st.ref_ns ? st.blocks / (st.ref_ns / 1e9) : 0) << " blocks/s, "
+					  << "variant " << (st.fast_ns ? st.blocks / (st.fast_ns / 1e9) : 0) << " blocks/s";
+				if (st.skipped)
+					std::cout << ", " << st.skipped << " CFGs skipped";
+				std::cout << "\n";
+			}
+			return false;
+		}
+	};
+}
+
+char Oracle::ID = 0;
+static RegisterPass<Oracle> M("oracle", "differential oracle harness for the fast variants");
+
+/* 7: CFG-shape fingerprints and near-duplicate clustering.
+ * Every function gets an exact fingerprint of its CFG in DFS order and a
+ * MinHash sketch over block, edge and loop features. Sketches are split into
+ * LSH bands, so only functions sharing a band bucket are ever compared, which
+ * keeps clustering roughly linear in the number of functions. */
+static cl::opt<double> DupThreshold("dup-threshold", cl::init(0.8),
+	cl::desc("dupcfg: minimum estimated feature similarity to cluster two functions"));
+static cl::opt<unsigned> DupTop("dup-top", cl::init(20),
+	cl::desc("dupcfg: number of merge candidates to list"));
+static cl::opt<unsigned> DupBytesPerInst("dup-bytes-per-inst", cl::init(4),
+	cl::desc("dupcfg: assumed code bytes per IR instruction"));
+
+namespace {
+	enum { MINHASH_K = 64, LSH_BANDS = 16, LSH_ROWS = MINHASH_K / LSH_BANDS };
+
+	struct FuncShape {
+		Function *F;
+		size_t fingerprint;
+		uint64_t sketch[MINHASH_K];
+		unsigned insts;
+	};
+
+	struct MergeCandidate {
+		double score;	/* estimated bytes saved */
+		std::vector<unsigned> members;
+		double similarity;	/* average against the first member */
+	};
+
+	unsigned find_root(std::vector<unsigned> &parent, unsigned x) {
+		while (parent[x] != x) {
+			parent[x] = parent[parent[x]];
+			x = parent[x];
+		}
+		return x;
+	}
+
+	double sketch_similarity(const FuncShape &a, const FuncShape &b) {
+		unsigned same = 0;
+		for (unsigned i = 0; i < MINHASH_K; i++)
+			if (a.sketch[i] == b.sketch[i])
+				same++;
+		return double(same) / MINHASH_K;
+	}
+
+	struct DupCFG : public ModulePass {
+		static char ID;
+		DupCFG() : ModulePass(ID) {}
+
+		void getAnalysisUsage(AnalysisUsage &AU) const {
+			AU.addRequired<LoopInfoWrapperPass>();
+			AU.setPreservesAll();
+		}
+
+		void shape(Function &F, LoopInfo &LI, FuncShape &fs) {
+			/* canonical ids: DFS preorder from the entry, then unreachable blocks */
+			DenseMap<const BasicBlock *, unsigned> ids;
+			std::vector<BasicBlock *> order;
+			for (df_iterator<BasicBlock *> bb = df_begin(&F.getEntryBlock()),
+				     bb_end = df_end(&F.getEntryBlock()); bb != bb_end; ++bb) {
+				ids[*bb] = order.size();
+				order.push_back(*bb);
+			}
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+				if (!ids.count(&*bb)) {
+					ids[&*bb] = order.size();
+					order.push_back(&*bb);
+				}
+			unsigned n = order.size();
+			std::vector<unsigned> preds(n, 0);
+			for (unsigned i = 0; i < n; i++) {
+				const TerminatorInst *TInst = order[i]->getTerminator();
+				for (unsigned j = 0, nSucc = TInst->getNumSuccessors(); j < nSucc; j++)
+					preds[ids[TInst->getSuccessor(j)]]++;
+			}
+
+			std::vector<size_t> block_feature(n);
+			std::vector<size_t> features;
+			hash_code fp = hash_value(n);
+			fs.insts = 0;
+			for (unsigned i = 0; i < n; i++) {
+				BasicBlock *blk = order[i];
+				const TerminatorInst *TInst = blk->getTerminator();
+				unsigned size = blk->size();
+				fs.insts += size;
+				unsigned size_bucket = 0;
+				while ((1u << size_bucket) < size)
+					size_bucket++;
+				block_feature[i] = hash_combine(TInst->getOpcode(), TInst->getNumSuccessors(),
+							       preds[i], size_bucket, LI.getLoopDepth(blk));
+				features.push_back(hash_combine(1, block_feature[i]));
+				fp = hash_combine(fp, TInst->getOpcode(), size, TInst->getNumSuccessors());
+				for (unsigned j = 0, nSucc = TInst->getNumSuccessors(); j < nSucc; j++)
+					fp = hash_combine(fp, ids[TInst->getSuccessor(j)]);
+			}
+			for (unsigned i = 0; i < n; i++) {
+				const TerminatorInst *TInst = order[i]->getTerminator();
+				for (unsigned j = 0, nSucc = TInst->getNumSuccessors(); j < nSucc; j++) {
+					unsigned succ = ids[TInst->getSuccessor(j)];
+					features.push_back(hash_combine(2, block_feature[i], block_feature[succ], succ <= i));
+				}
+			}
+			for_each_loop(LI, [&](Loop *L) {
+				SmallVector<BasicBlock *, 8> exiting;
+				L->getExitingBlocks(exiting);
+				features.push_back(hash_combine(3, L->getLoopDepth(), L->getNumBlocks(), exiting.size()));
+			});
+			fs.fingerprint = fp;
+
+			/* repeated features count separately, so the sketch sees a multiset */
+			std::sort(features.begin(), features.end());
+			for (unsigned i = 0; i < MINHASH_K; i++)
+				fs.sketch[i] = std::numeric_limits<uint64_t>::max();
+			/* features are sorted, so copies are adjacent: count within each run */
+			unsigned occurrence = 0;
+			for (unsigned f = 0; f < features.size(); f++) {
+				if (f > 0 && features[f] == features[f - 1])
+					occurrence++;
+				else
+					occurrence = 0;
+				size_t feature = hash_combine(features[f], occurrence);
+				for (unsigned i = 0; i < MINHASH_K; i++)
+					fs.sketch[i] = std::min<uint64_t>(fs.sketch[i], hash_combine(feature, i));
+			}
+		}
+
+		bool runOnModule(Module &M) override {
+			std::vector<FuncShape> shapes;
+			for (Module::iterator f = M.begin(); f != M.end(); f++) {
+				if (f->isDeclaration())
+					continue;
+				FuncShape fs;
+				fs.F = &*f;
+				shape(*f, getAnalysis<LoopInfoWrapperPass>(*f).getLoopInfo(), fs);
+				shapes.push_back(fs);
+			}
+
+			std::vector<unsigned> parent(shapes.size());
+			for (unsigned i = 0; i < shapes.size(); i++)
+				parent[i] = i;
+			/* each bucket's members are compared against its first member only */
+			std::map<size_t, unsigned> exact;
+			std::map<size_t, unsigned> buckets;
+			unsigned exact_dups = 0;
+			for (unsigned i = 0; i < shapes.size(); i++) {
+				std::pair<std::map<size_t, unsigned>::iterator, bool> ins =
+					exact.insert(std::make_pair(shapes[i].fingerprint, i));
+				if (!ins.second) {
+					parent[find_root(parent, i)] = find_root(parent, ins.first->second);
+					exact_dups++;
+					continue;
+				}
+				for (unsigned b = 0; b < LSH_BANDS; b++) {
+					hash_code key = hash_value(b);
+					for (unsigned r = 0; r < LSH_ROWS; r++)
+						key = hash_combine(key, shapes[i].sketch[b * LSH_ROWS + r]);
+					std::pair<std::map<size_t, unsigned>::iterator, bool> bucket =
+						buckets.insert(std::make_pair((size_t)key, i));
+					if (bucket.second)
+						continue;
+					unsigned other = bucket.first->second;
+					if (sketch_similarity(shapes[i], shapes[other]) >= DupThreshold)
+						parent[find_root(parent, i)] = find_root(parent, other);
+				}
+			}
+
+			std::map<unsigned, std::vector<unsigned> > clusters;
+			for (unsigned i = 0; i < shapes.size(); i++)
+				clusters[find_root(parent, i)].push_back(i);
+			TopN<MergeCandidate> top;
+			top.limit = DupTop;
+			unsigned clustered = 0, cluster_count = 0;
+			for (std::map<unsigned, std::vector<unsigned> >::iterator it = clusters.begin(); it != clusters.end(); it++) {
+				std::vector<unsigned> &members = it->second;
+				if (members.size() < 2)
+					continue;
+				cluster_count++;
+				clustered += members.size();
+				/* keep the largest copy; the rest are saved in proportion to similarity */
+				std::sort(members.begin(), members.end(), [&shapes](unsigned a, unsigned b) {
+					return shapes[a].insts > shapes[b].insts;
+				});
+				MergeCandidate mc;
+				mc.members = members;
+				mc.score = 0;
+				mc.similarity = 0;
+				for (unsigned m = 1; m < members.size(); m++) {
+					double sim = shapes[members[m]].fingerprint == shapes[members[0]].fingerprint ?
+						1.0 : sketch_similarity(shapes[members[m]], shapes[members[0]]);
+					mc.similarity += sim / (members.size() - 1);
+					mc.score += sim * shapes[members[m]].insts * DupBytesPerInst;
+				}
+				top.insert(mc);
+			}
+
+			std::vector<MergeCandidate> ranked = top.sorted();
+			for (unsigned i = 0; i < ranked.size(); i++) {
+				const MergeCandidate &mc = ranked[i];
+				std::cout << i + 1 << ". ~" << (unsigned long)mc.score << " bytes, similarity "
+					  << mc.similarity << ":";
+				for (unsigned m = 0; m < mc.members.size(); m++)
+					std::cout << " " << shapes[mc.members[m]].F->getName().str();
+				std::cout << "\n";
+			}
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			std::cout << "functions: " << shapes.size() << "\n";
+			std::cout << "identical CFG fingerprints: " << exact_dups << "\n";
+			std::cout << "clusters: " << cluster_count << " (" << clustered << " functions)\n";
+			return false;
+		}
+	};
+}
+
+char DupCFG::ID = 0;
+static RegisterPass<DupCFG> N("dupcfg", "CFG fingerprints and near-duplicate function clusters");
+
+/* 8: Cold regions for hot/cold splitting, without a profile. Seeds are the
+ * blocks that inevitably end the normal flow: ones ending in unreachable
+ * (abort-like noreturn calls included) or resume, invokes of a noreturn
+ * callee, and EH pads (landing pads and funclet pads alike). Coldness then
+ * spreads backwards: a block is cold when all of its successors are, or when
+ * its immediate post-dominator is, since every path from it that finishes
+ * runs into that block. A call to a cold-attributed function only marks its
+ * own block, since such calls often sit on a shared return path. Calls like
+ * exit() also end in unreachable, so a main() that exits is cold throughout. */
+namespace {
+	struct ColdPaths : public FunctionPass {
+		static char ID;
+		static unsigned blocks, cold_blocks;
+		static unsigned insts, cold_insts;
+		static unsigned entry_edges;
+		ColdPaths() : FunctionPass(ID) {}
+
+		void getAnalysisUsage(AnalysisUsage &AU) const {
+			AU.addRequired<PostDominatorTree>();
+			AU.setPreservesAll();
+		}
+
+		/* seeds the backward walk */
+		static bool is_cold_sink(BasicBlock &blk) {
+			const TerminatorInst *TInst = blk.getTerminator();
+			if (isa<UnreachableInst>(TInst) || isa<ResumeInst>(TInst) || blk.isEHPad())
+				return true;
+			if (const InvokeInst *II = dyn_cast<InvokeInst>(TInst))
+				return II->doesNotReturn();
+			return false;
+		}
+
+		/* cold on its own, but doesn't spread */
+		static bool calls_cold(BasicBlock &blk) {
+			for (BasicBlock::iterator inst = blk.begin(); inst != blk.end(); inst++) {
+				if (CallInst *CI = dyn_cast<CallInst>(&*inst)) {
+					if (CI->hasFnAttr(Attribute::Cold))
+						return true;
+				} else if (InvokeInst *II = dyn_cast<InvokeInst>(&*inst)) {
+					if (II->hasFnAttr(Attribute::Cold))
 						return true;
-					else if (visited.count(succ) != 1)
-						q.push(succ);
 				}
 			}
 			return false;
 		}
 
+		bool runOnFunction(Function &F) override {
+			PostDominatorTree *PDT = &getAnalysis<PostDominatorTree>();
+			DenseMap<const BasicBlock *, unsigned> ids;
+			number_blocks(F, ids);
+			std::vector<bool> cold(F.size(), false);
+			/* successor edges not known to be cold yet */
+			std::vector<unsigned> warm_succs(F.size(), 0);
+			std::vector<BasicBlock *> worklist;
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+				warm_succs[ids[&*bb]] = bb->getTerminator()->getNumSuccessors();
+				if (is_cold_sink(*bb)) {
+					cold[ids[&*bb]] = true;
+					worklist.push_back(&*bb);
+				}
+			}
+			while (!worklist.empty()) {
+				BasicBlock *blk = worklist.back();
+				worklist.pop_back();
+				for (pred_iterator pred = pred_begin(blk); pred != pred_end(blk); pred++) {
+					unsigned id = ids[*pred];
+					if (!cold[id] && --warm_succs[id] == 0) {
+						cold[id] = true;
+						worklist.push_back(*pred);
+					}
+				}
+				if (DomTreeNode *node = PDT->getNode(blk))
+					for (DomTreeNode::iterator child = node->begin(); child != node->end(); child++) {
+						BasicBlock *c = (*child)->getBlock();
+						if (c && !cold[ids[c]]) {
+							cold[ids[c]] = true;
+							worklist.push_back(c);
+						}
+					}
+			}
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+				if (calls_cold(*bb))
+					cold[ids[&*bb]] = true;
+
+			unsigned f_cold_blocks = 0, f_insts = 0, f_cold_insts = 0;
+			std::vector<std::pair<BasicBlock *, BasicBlock *> > entries;
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++) {
+				f_insts += bb->size();
+				if (cold[ids[&*bb]]) {
+					f_cold_blocks++;
+					f_cold_insts += bb->size();
+					continue;
+				}
+				const TerminatorInst *TInst = bb->getTerminator();
+				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++)
+					if (cold[ids[TInst->getSuccessor(i)]])
+						entries.push_back(std::make_pair(&*bb, TInst->getSuccessor(i)));
+			}
+
+			errs() << F.getName() << ": cold blocks " << f_cold_blocks << "/" << F.size()
+			       << " (" << format("%.1f", 100.0 * f_cold_blocks / F.size()) << "%), cold insts "
+			       << f_cold_insts << "/" << f_insts
+			       << " (" << format("%.1f", 100.0 * f_cold_insts / f_insts) << "%)\n";
+			/* as operands, so unnamed blocks still show up as %N */
+			for (unsigned i = 0; i < entries.size(); i++) {
+				errs() << "  cold entry: ";
+				entries[i].first->printAsOperand(errs(), false);
+				errs() << " -> ";
+				entries[i].second->printAsOperand(errs(), false);
+				errs() << "\n";
+			}
+
+			blocks += F.size();
+			cold_blocks += f_cold_blocks;
+			insts += f_insts;
+			cold_insts += f_cold_insts;
+			entry_edges += entries.size();
+			return false;
+		}
+
 		bool doFinalization(Module &M) override {
 			std::cout << "------------------------------\n";
 			std::cout << "Summary:\n";
+			std::cout << "cold blocks: " << cold_blocks << "/" << blocks << "\n";
+			std::cout << "cold instructions: " << cold_insts << "/" << insts << "\n";
+			std::cout << "cold region entry edges: " << entry_edges << "\n";
 			return false;
 		}
 	};
 }
 
-char Reach::ID = 0;
-static RegisterPass<Reach> H("reach", "reachability from basic block A to B");
+char ColdPaths::ID = 0;
+unsigned ColdPaths::blocks;
+unsigned ColdPaths::cold_blocks;
+unsigned ColdPaths::insts;
+unsigned ColdPaths::cold_insts;
+unsigned ColdPaths::entry_edges;
+static RegisterPass<ColdPaths> O("cold", "cold regions that inevitably reach unreachable, noreturn or EH code");
+
+/* 9: Dead blocks and blocks that never exit. One forward walk from the entry
+ * and one backward walk from every block without successors (ret, resume,
+ * unreachable), each over a bitset. Blocks missed by the first are dead code
+ * still being compiled; blocks missed by the second can only loop forever,
+ * which also leaves them out of the post-dominator tree. */
+namespace {
+	struct EntryExitReach : public FunctionPass {
+		static char ID;
+		static unsigned func_count;
+		static unsigned blocks;
+		static unsigned dead_blocks, dead_funcs;
+		static unsigned no_exit_blocks, no_exit_funcs;
+		EntryExitReach() : FunctionPass(ID) {}
+
+		bool runOnFunction(Function &F) override {
+			DenseMap<const BasicBlock *, unsigned> ids;
+			number_blocks(F, ids);
+			BitVector from_entry(F.size());
+			BitVector to_exit(F.size());
+			std::vector<BasicBlock *> worklist;
+
+			worklist.push_back(&F.getEntryBlock());
+			from_entry.set(0);
+			while (!worklist.empty()) {
+				BasicBlock *blk = worklist.back();
+				worklist.pop_back();
+				const TerminatorInst *TInst = blk->getTerminator();
+				for (unsigned i = 0, nSucc = TInst->getNumSuccessors(); i < nSucc; i++) {
+					unsigned id = ids[TInst->getSuccessor(i)];
+					if (!from_entry.test(id)) {
+						from_entry.set(id);
+						worklist.push_back(TInst->getSuccessor(i));
+					}
+				}
+			}
+
+			for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+				if (bb->getTerminator()->getNumSuccessors() == 0) {
+					to_exit.set(ids[&*bb]);
+					worklist.push_back(&*bb);
+				}
+			while (!worklist.empty()) {
+				BasicBlock *blk = worklist.back();
+				worklist.pop_back();
+				for (pred_iterator pred = pred_begin(blk); pred != pred_end(blk); pred++) {
+					unsigned id = ids[*pred];
+					if (!to_exit.test(id)) {
+						to_exit.set(id);
+						worklist.push_back(*pred);
+					}
+				}
+			}
+
+			unsigned dead = F.size() - from_entry.count();
+			/* dead blocks that never exit are only reported as dead */
+			BitVector stuck = to_exit;
+			stuck.flip();
+			stuck &= from_entry;
+			unsigned no_exit = stuck.count();
+
+			func_count++;
+			blocks += F.size();
+			dead_blocks += dead;
+			no_exit_blocks += no_exit;
+			if (dead)
+				dead_funcs++;
+			if (no_exit)
+				no_exit_funcs++;
+			if (!dead && !no_exit)
+				return false;
+
+			errs() << F.getName() << ": " << dead << " unreachable from entry, "
+			       << no_exit << " cannot reach an exit\n";
+			/* as operands, so unnamed blocks still show up as %N */
+			if (dead) {
+				errs() << "  dead:";
+				for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+					if (!from_entry.test(ids[&*bb])) {
+						errs() << " ";
+						bb->printAsOperand(errs(), false);
+					}
+				errs() << "\n";
+			}
+			if (no_exit) {
+				errs() << "  no exit:";
+				for (Function::iterator bb = F.begin(); bb != F.end(); bb++)
+					if (stuck.test(ids[&*bb])) {
+						errs() << " ";
+						bb->printAsOperand(errs(), false);
+					}
+				errs() << "\n";
+			}
+			return false;
+		}
+
+		bool doFinalization(Module &M) override {
+			std::cout << "------------------------------\n";
+			std::cout << "Summary:\n";
+			std::cout << "functions: " << func_count << ", blocks: " << blocks << "\n";
+			std::cout << "unreachable from entry: " << dead_blocks << " blocks in "
+				  << dead_funcs << " functions\n";
+			std::cout << "cannot reach an exit: " << no_exit_blocks << " blocks in "
+				  << no_exit_funcs << " functions\n";
+			return false;
+		}
+	};
+}
+
+char EntryExitReach::ID = 0;
+unsigned EntryExitReach::func_count;
+unsigned EntryExitReach::blocks;
+unsigned EntryExitReach::dead_blocks;
+unsigned EntryExitReach::dead_funcs;
+unsigned EntryExitReach::no_exit_blocks;
+unsigned EntryExitReach::no_exit_funcs;
+static RegisterPass<EntryExitReach> P("deadblocks", "blocks unreachable from entry or unable to reach an exit");